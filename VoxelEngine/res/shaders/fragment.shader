@@ -3,6 +3,7 @@
 layout(location = 0) out vec4 color;
 
 in vec2 v_TexCoord;
+flat in vec2 v_Tile;
 in float v_VertexAO;
 in float v_LightLevel;
 in float v_FogDepth;
@@ -10,6 +11,9 @@ in float v_WorldY;
 
 uniform sampler2D u_Texture;
 
+// The atlas is 32x32 tiles. UVs are in blocks so greedy merged quads repeat the tile
+const float TILE_SIZE = 1.0 / 32.0;
+
 // FOG
 uniform vec3  u_FogColor;
 uniform float u_FogDensity;
@@ -19,7 +23,7 @@ uniform int   u_FogMode;
 
 void main()
 {
-    vec4 texColor = texture(u_Texture, v_TexCoord);
+    vec4 texColor = texture(u_Texture, (v_Tile + fract(v_TexCoord)) * TILE_SIZE);
     if (texColor.a < 0.1)
         discard;
 
@@ -1,15 +1,16 @@
 #version 330 core
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec2 texCoord;
-layout(location = 2) in float vertexAO;
-layout(location = 3) in float lightLevel;
+// Packed vertex, see Vertex in Chunk.h
+layout(location = 0) in uint data0; // x 5 | y 8 | z 5 | ao 2 | light 4
+layout(location = 1) in uint data1; // tile 10 | u 5 | v 5
+layout(location = 2) in vec3 a_ChunkOrigin; // One per draw, see ChunkMeshArena
 
 uniform mat4 u_Model;
 uniform mat4 u_View;
 uniform mat4 u_Proj;
 
 out vec2 v_TexCoord;
+flat out vec2 v_Tile;
 out float v_VertexAO;
 out float v_LightLevel;
 out float v_FogDepth;
@@ -17,14 +18,19 @@ out float v_WorldY; // height for height fog
 
 void main()
 {
+    // Vertices are block corners, blocks are centered on their coordinate
+    vec3 position = a_ChunkOrigin + vec3(data0 & 31u, (data0 >> 5) & 255u, (data0 >> 13) & 31u) - 0.5;
+    uint tile = data1 & 1023u;
+
     vec4 worldPos = u_Model * vec4(position, 1.0);
     vec4 viewPos = u_View * worldPos;
 
     gl_Position = u_Proj * viewPos;
 
-    v_TexCoord = texCoord;
-    v_VertexAO = vertexAO;
-    v_LightLevel = lightLevel;
+    v_TexCoord = vec2((data1 >> 10) & 31u, (data1 >> 15) & 31u);
+    v_Tile = vec2(tile & 31u, tile >> 5);
+    v_VertexAO = float((data0 >> 18) & 3u) / 3.0;
+    v_LightLevel = float((data0 >> 20) & 15u) / 15.0;
     v_FogDepth = -viewPos.z; // camera distance
     v_WorldY = worldPos.y;   // world space height
 }
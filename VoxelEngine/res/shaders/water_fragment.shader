@@ -3,11 +3,14 @@
 layout(location = 0) out vec4 color;
 
 in vec2 v_TexCoord;
+flat in vec2 v_Tile;
 in float v_VertexAO;
 
 uniform sampler2D u_Texture;
 
+const float TILE_SIZE = 1.0 / 32.0;
+
 void main()
 {
-	color = texture( u_Texture, v_TexCoord );    
+	color = texture( u_Texture, (v_Tile + fract(v_TexCoord)) * TILE_SIZE );    
 }
\ No newline at end of file
@@ -1,25 +1,29 @@
 #version 330 core
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec2 texCoord;
-layout(location = 2) in float vertexAO;
-layout(location = 3) in float lightLevel;
+// Packed vertex, see Vertex in Chunk.h
+layout(location = 0) in uint data0; // x 5 | y 8 | z 5 | ao 2 | light 4
+layout(location = 1) in uint data1; // tile 10 | u 5 | v 5
+layout(location = 2) in vec3 a_ChunkOrigin; // One per draw, see ChunkMeshArena
 
 uniform mat4 u_MVP;
 uniform float u_Time;
 
 out vec2 v_TexCoord;
+flat out vec2 v_Tile;
 out float v_VertexAO;
 
 void main()
 {
-    vec3 pos = position;
+    // Vertices are block corners, blocks are centered on their coordinate
+    vec3 pos = a_ChunkOrigin + vec3(data0 & 31u, (data0 >> 5) & 255u, (data0 >> 13) & 31u) - 0.5;
+    uint tile = data1 & 1023u;
 
     float wave = sin(u_Time * 1.5 + pos.x * 0.8 + pos.z * 0.8) * 0.08;
     pos.y += wave;
 
     gl_Position = u_MVP * vec4(pos, 1.0);
 
-    v_TexCoord = texCoord;
-    v_VertexAO = vertexAO;
+    v_TexCoord = vec2((data1 >> 10) & 31u, (data1 >> 15) & 31u);
+    v_Tile = vec2(tile & 31u, tile >> 5);
+    v_VertexAO = float((data0 >> 18) & 3u) / 3.0;
 }
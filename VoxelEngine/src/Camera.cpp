@@ -19,6 +19,9 @@ void Camera::ProcessKeyboard(Input& input, float deltaTime)
         m_Position += m_Front * (float)input.GetVerticalMoveInput() * velocity;
     if (input.GetHorizontalMoveInput() != 0)
         m_Position += glm::normalize(glm::cross(m_Front, m_Up)) * (float)input.GetHorizontalMoveInput() * velocity;
+
+    // The frustum moves with the camera, not only when looking around
+    m_Frustum.SetCamDef(m_Position, m_Position + m_Front, m_Up);
 }
 
 void Camera::ProcessMouse(Vector2f mouseDelta)
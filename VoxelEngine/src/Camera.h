@@ -42,6 +42,10 @@ public:
 	glm::vec3 GetUp() const { return m_Up; }
 
 	bool FrustumIntersectsAABB(glm::vec3 boxMin, glm::vec3 boxMax) const;
+	int FrustumTestAABB(glm::vec3 boxMin, glm::vec3 boxMax) const { return m_Frustum.BoxInFrustum({ boxMin, boxMax }); }
+
+	// CameraFrustum::OUTSIDE, INSIDE or INTERSECT per box, for culling many boxes at once
+	void FrustumTestBoxes(const AABoxBatch& boxes, std::vector<uint8_t>& results) const { m_Frustum.BoxesInFrustum(boxes, results); }
 
 private:
 	void UpdateCameraVectors();
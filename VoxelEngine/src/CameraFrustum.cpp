@@ -75,6 +75,7 @@ void CameraFrustum::SetCamDef(const glm::vec3& p, const glm::vec3& l, const glm:
 
 int CameraFrustum::BoxInFrustum(const AABox& box) const
 {
+	int result = INSIDE;
 	for (int i = 0; i < 6; i++)
 	{
 		const glm::vec3& n = pl[i].normal;
@@ -88,14 +89,136 @@ int CameraFrustum::BoxInFrustum(const AABox& box) const
 
 		// outside if positive vertex is behind plane
 		if (glm::dot(n, pv) + pl[i].d < 0)
-			return false;
+			return OUTSIDE;
+
+		// The negative vertex is the corner furthest behind the plane, if it is behind the box crosses the plane
+		glm::vec3 nv = {
+			n.x >= 0 ? box.min.x : box.max.x,
+			n.y >= 0 ? box.min.y : box.max.y,
+			n.z >= 0 ? box.min.z : box.max.z
+		};
+
+		if (glm::dot(n, nv) + pl[i].d < 0)
+			result = INTERSECT;
 	}
-	return true; // Intersect
+	return result;
 
 	/*
 	* In the method from the paper we would do:
 	* 6 Planes * 8 Corners = 48 Dot Products per Box.
 	* 
-	* With this method
+	* With this method we only need 2 per plane, 12 per Box.
 	*/
-}
\ No newline at end of file
+}
+
+namespace {
+
+	// One plane with the box arrays that hold its positive and negative vertex.
+	// Which corner that is only depends on the signs of the normal, so it is picked once per plane and not per box.
+	struct BatchPlane
+	{
+		float nx, ny, nz, d;
+		const float* px; const float* py; const float* pz;
+		const float* nxv; const float* nyv; const float* nzv;
+	};
+
+	// Lanes with their bit set in outside are OUTSIDE, else in intersect INTERSECT, else INSIDE
+	void WriteResults(int outside, int intersect, int lanes, uint8_t* results)
+	{
+		static_assert(CameraFrustum::OUTSIDE == 0 && CameraFrustum::INSIDE == 1 && CameraFrustum::INTERSECT == 2);
+
+		// Branchless, the pattern is random enough that branches mispredict a lot
+		for (int lane = 0; lane < lanes; lane++)
+			results[lane] = (uint8_t)((~outside >> lane & 1) * (1 + (intersect >> lane & 1)));
+	}
+}
+
+void CameraFrustum::BoxesInFrustum(const AABoxBatch& boxes, std::vector<uint8_t>& results) const
+{
+	size_t count = boxes.PaddedCount();
+	results.resize(count);
+
+	BatchPlane planes[6];
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::vec3& n = pl[i].normal;
+		BatchPlane& plane = planes[i];
+
+		plane.nx = n.x; plane.ny = n.y; plane.nz = n.z; plane.d = pl[i].d;
+		plane.px = (n.x >= 0 ? boxes.maxX : boxes.minX).data();
+		plane.py = (n.y >= 0 ? boxes.maxY : boxes.minY).data();
+		plane.pz = (n.z >= 0 ? boxes.maxZ : boxes.minZ).data();
+		plane.nxv = (n.x >= 0 ? boxes.minX : boxes.maxX).data();
+		plane.nyv = (n.y >= 0 ? boxes.minY : boxes.maxY).data();
+		plane.nzv = (n.z >= 0 ? boxes.minZ : boxes.maxZ).data();
+	}
+
+#if VOXEL_AVX
+	const __m256 zero = _mm256_setzero_ps();
+	for (size_t i = 0; i < count; i += 8)
+	{
+		__m256 outside = zero;
+		__m256 intersect = zero;
+
+		for (const BatchPlane& plane : planes)
+		{
+			__m256 nx = _mm256_set1_ps(plane.nx);
+			__m256 ny = _mm256_set1_ps(plane.ny);
+			__m256 nz = _mm256_set1_ps(plane.nz);
+			__m256 d = _mm256_set1_ps(plane.d);
+
+			__m256 distP = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_loadu_ps(plane.px + i)), _mm256_mul_ps(ny, _mm256_loadu_ps(plane.py + i))),
+				_mm256_add_ps(_mm256_mul_ps(nz, _mm256_loadu_ps(plane.pz + i)), d));
+			__m256 distN = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_loadu_ps(plane.nxv + i)), _mm256_mul_ps(ny, _mm256_loadu_ps(plane.nyv + i))),
+				_mm256_add_ps(_mm256_mul_ps(nz, _mm256_loadu_ps(plane.nzv + i)), d));
+
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(distP, zero, _CMP_LT_OQ));
+			intersect = _mm256_or_ps(intersect, _mm256_cmp_ps(distN, zero, _CMP_LT_OQ));
+		}
+
+		WriteResults(_mm256_movemask_ps(outside), _mm256_movemask_ps(intersect), 8, results.data() + i);
+	}
+#elif VOXEL_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	for (size_t i = 0; i < count; i += 4)
+	{
+		__m128 outside = zero;
+		__m128 intersect = zero;
+
+		for (const BatchPlane& plane : planes)
+		{
+			__m128 nx = _mm_set1_ps(plane.nx);
+			__m128 ny = _mm_set1_ps(plane.ny);
+			__m128 nz = _mm_set1_ps(plane.nz);
+			__m128 d = _mm_set1_ps(plane.d);
+
+			__m128 distP = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(plane.px + i)), _mm_mul_ps(ny, _mm_loadu_ps(plane.py + i))),
+				_mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(plane.pz + i)), d));
+			__m128 distN = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(plane.nxv + i)), _mm_mul_ps(ny, _mm_loadu_ps(plane.nyv + i))),
+				_mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(plane.nzv + i)), d));
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distP, zero));
+			intersect = _mm_or_ps(intersect, _mm_cmplt_ps(distN, zero));
+		}
+
+		WriteResults(_mm_movemask_ps(outside), _mm_movemask_ps(intersect), 4, results.data() + i);
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+	{
+		int outside = 0;
+		int intersect = 0;
+
+		for (const BatchPlane& plane : planes)
+		{
+			float distP = plane.nx * plane.px[i] + plane.ny * plane.py[i] + (plane.nz * plane.pz[i] + plane.d);
+			float distN = plane.nx * plane.nxv[i] + plane.ny * plane.nyv[i] + (plane.nz * plane.nzv[i] + plane.d);
+
+			outside |= distP < 0;
+			intersect |= distN < 0;
+		}
+
+		WriteResults(outside, intersect, 1, results.data() + i);
+	}
+#endif
+}
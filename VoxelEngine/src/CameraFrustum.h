@@ -1,5 +1,17 @@
 #pragma once
 #include <glm.hpp>
+#include <vector>
+#include <cstdint>
+
+#if defined(__AVX__)
+#define VOXEL_AVX 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOXEL_SSE2 1
+#include <emmintrin.h>
+#endif
 
 #define ANG2RAD 3.14159265358979323846/180.0
 
@@ -20,6 +32,42 @@ struct AABox
 	}
 };
 
+/*
+* Many boxes in structure of arrays form, so BoxesInFrustum can test 8 (AVX) or 4 (SSE2) of them per instruction.
+* The arrays are padded with empty boxes to a multiple of BATCH, the SIMD loops never need a scalar tail.
+*/
+struct AABoxBatch
+{
+	static constexpr size_t BATCH = 8;
+
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+	size_t count = 0;
+
+	void Clear()
+	{
+		count = 0;
+		minX.clear(); minY.clear(); minZ.clear();
+		maxX.clear(); maxY.clear(); maxZ.clear();
+	}
+
+	void Add(const glm::vec3& min, const glm::vec3& max)
+	{
+		if (count % BATCH == 0)
+		{
+			size_t padded = count + BATCH;
+			minX.resize(padded); minY.resize(padded); minZ.resize(padded);
+			maxX.resize(padded); maxY.resize(padded); maxZ.resize(padded);
+		}
+
+		minX[count] = min.x; minY[count] = min.y; minZ[count] = min.z;
+		maxX[count] = max.x; maxY[count] = max.y; maxZ[count] = max.z;
+		count++;
+	}
+
+	size_t PaddedCount() const { return minX.size(); }
+};
+
 // The Camera Frustum Plane
 struct AAPlane
 {
@@ -84,4 +132,7 @@ public:
 	void SetCamInternals(float angle, float ratio, float nearD, float farD);
 	void SetCamDef(const glm::vec3& p, const glm::vec3& l, const glm::vec3& u);
 	int BoxInFrustum(const AABox& b) const;
+
+	// OUTSIDE, INSIDE or INTERSECT for every box of the batch, results is resized to the padded count
+	void BoxesInFrustum(const AABoxBatch& boxes, std::vector<uint8_t>& results) const;
 };
\ No newline at end of file
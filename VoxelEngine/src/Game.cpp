@@ -72,6 +72,7 @@ void Game::Init()
     m_CutoutShader = std::make_unique<Shader>("res/shaders/vertex.shader", "res/shaders/fragment.shader");
     m_WaterShader = std::make_unique<Shader>("res/shaders/water_vertex.shader", "res/shaders/water_fragment.shader");
 	m_FogShader = std::make_unique<Shader>("res/shaders/fog_vert.shader", "res/shaders/fog_frag.shader");
+    m_OutlineShader = std::make_unique<Shader>("res/shaders/outline_vertex.shader", "res/shaders/outline_fragment.shader");
 
     m_AtlasTexture = std::make_unique<Texture>("res/textures/atlas.png");
 
@@ -139,11 +140,7 @@ void Game::ProcessInput(float deltaTime)
 
 void Game::Update(float deltaTime)
 {
-    m_World->UpdateChunksInRadius(  
-        World::WorldToChunk(static_cast<int>(m_Camera->GetPosition().x)),
-        World::WorldToChunk(static_cast<int>(m_Camera->GetPosition().z)),
-        m_RenderDistance * 3
-    );
+    m_World->UpdateChunksInRadius(*m_Camera, m_RenderDistance * 3);
 }
 
 void Game::Render()
@@ -157,6 +154,9 @@ void Game::Render()
     // Bind texture atlas
     m_AtlasTexture->Bind(0);
 
+    // Visibility once for all three passes
+    m_World->CullChunks(*m_Camera, m_Projection);
+
     // SOLID BLOCK PASS
 	glDisable(GL_BLEND);
 	glDepthMask(true);
@@ -174,14 +174,14 @@ void Game::Render()
     m_WorldShader->SetUniform1f("u_FogHeight", m_FogHeight);
     m_WorldShader->SetUniform1i("u_FogMode", m_FogMode);
 
-    m_World->Render(*m_Renderer, *m_WorldShader, *m_Camera, 0);
+    m_World->Render(*m_Renderer, 0);
 
     // CUTOUT BLOCK PASS
     m_CutoutShader->Bind();
     m_CutoutShader->SetUniformMat4f("u_MVP", mvp);
     m_CutoutShader->SetUniform1i("u_Texture", 0);
 
-    m_World->Render(*m_Renderer, *m_CutoutShader, *m_Camera, 1);
+    m_World->Render(*m_Renderer, 1);
 
 
 	// TRANSLUCENT BLOCK PASS
@@ -194,7 +194,7 @@ void Game::Render()
     m_WaterShader->SetUniform1i("u_Texture", 0);
     m_WaterShader->SetUniform1f("u_Time", static_cast<float>(glfwGetTime()));
 
-    m_World->Render(*m_Renderer, *m_WaterShader, *m_Camera, 2);
+    m_World->Render(*m_Renderer, 2);
 
     // Reset Rendering State
     glDepthMask(GL_TRUE);
@@ -202,7 +202,10 @@ void Game::Render()
 
     if (m_World->Raycast(m_Camera->GetPosition(), m_Camera->GetFront(), 15.0f, m_HitBlock, m_PlaceBlock))
     {
-        m_World->RenderBlockOutline(*m_Renderer, *m_WorldShader, m_HitBlock.x, m_HitBlock.y, m_HitBlock.z);
+        m_OutlineShader->Bind();
+        m_OutlineShader->SetUniformMat4f("u_MVP", mvp);
+        m_OutlineShader->SetUniform4f("u_Color", 0.0f, 0.0f, 0.0f, 1.0f);
+        m_World->RenderBlockOutline(*m_Renderer, *m_OutlineShader, m_HitBlock.x, m_HitBlock.y, m_HitBlock.z);
     }
 
     m_Renderer->DrawSkybox(*m_Skybox, view, m_Projection);
@@ -225,6 +228,49 @@ void Game::RenderImGui()
 	ImGui::Text("Current Chunk Position: X %d | Z %d", World::WorldToChunk(static_cast<int>(m_Camera->GetPosition().x)), World::WorldToChunk(static_cast<int>(m_Camera->GetPosition().z)));
 
     ImGui::Checkbox("Frustum Culling", &m_World->frustumCulling);
+    ImGui::Checkbox("Tight Chunk Bounds", &m_World->tightChunkBounds);
+    ImGui::Checkbox("Hierarchical Culling", &m_World->hierarchicalCulling);
+    World::CullStats cullStats = m_World->GetCullStats();
+    ImGui::Text("Culling: %d chunks | %d visible (%d inside) | %d empty", cullStats.candidates, cullStats.visible, cullStats.inside, cullStats.empty);
+    ImGui::Text("Frustum Tests: %d regions | %d chunks", cullStats.regionTests, cullStats.chunkTests);
+    ImGui::Checkbox("Occlusion Culling", &m_World->occlusionCulling);
+    ImGui::Text("Sections: %d in frustum | %d drawn | %d visited", cullStats.sectionsInFrustum, cullStats.sectionsDrawn, cullStats.visitedSections);
+    ImGui::Text("Occluded Chunks: %d", cullStats.occluded);
+    ImGui::Checkbox("Depth Occlusion Culling", &m_World->depthOcclusionCulling);
+    ImGui::SliderInt("Occluder Distance", &m_World->occluderDistance, 1, 8);
+    ImGui::Text("Occluders: %d boxes | %d triangles | %d/%d bands on workers", cullStats.occluderBoxes, cullStats.occluderTriangles, cullStats.workerBands, OcclusionBuffer::BAND_COUNT);
+    ImGui::Text("Depth Occluded: %d of %d chunks", cullStats.depthOccluded, cullStats.depthTested);
+    ImGui::Checkbox("Show Occlusion Buffer", &m_ShowOcclusionBuffer);
+    ImGui::Text("Drawn: Solid %d | Cutout %d | Water %d", cullStats.drawn[0], cullStats.drawn[1], cullStats.drawn[2]);
+
+    if (ImGui::Checkbox("Greedy Meshing", &m_World->greedyMeshing))
+        m_World->RemeshAllChunks();
+
+    World::MeshStats meshStats = m_World->GetMeshStats();
+    ImGui::Text("Vertices: Solid %zu | Water %zu", meshStats.solidVertices, meshStats.waterVertices);
+    ImGui::Text("Mesh Jobs: %zu for %zu chunks (%.2f per chunk)", meshStats.meshJobs, meshStats.meshedChunks,
+        meshStats.meshedChunks > 0 ? (float)meshStats.meshJobs / meshStats.meshedChunks : 0.0f);
+
+    ImGui::Text("Workers: %d | Pending Jobs: %d", m_World->GetWorkerCount(), m_World->GetPendingJobs());
+    World::CancelStats cancelStats = m_World->GetCancelStats();
+    ImGui::Text("Cancelled Jobs: Terrain %llu | Mesh %llu", (unsigned long long)cancelStats.terrainJobs, (unsigned long long)cancelStats.meshJobs);
+
+    MeshBufferPool::Stats poolStats = m_World->GetMeshBufferPool().GetStats();
+    ImGui::Text("Mesh Buffers: %llu acquired | %llu allocations", (unsigned long long)poolStats.acquired, (unsigned long long)poolStats.allocations);
+    ImGui::Text("Mesh Buffer Pool: %zu free (%.1f MB)", poolStats.freeBuffers, poolStats.freeBytes / (1024.0f * 1024.0f));
+
+    ChunkMeshArena::Stats arenaStats = m_World->GetMeshArena().GetStats();
+    ImGui::Text("Mesh Arena: %.1f / %.1f MB | %zu free blocks", arenaStats.usedBytes / (1024.0f * 1024.0f), arenaStats.capacityBytes / (1024.0f * 1024.0f), arenaStats.freeBlocks);
+    ImGui::Text("Chunk Draws: %d (%s)", arenaStats.draws, arenaStats.multiDrawIndirect ? "multi draw indirect" : "base vertex fallback");
+
+    World::ResidencyStats residency = m_World->GetResidencyStats();
+    ImGui::Text("Loaded Chunks: %zu (%.1f MB) | Unloaded: %zu", residency.loadedChunks, residency.bytes / (1024.0f * 1024.0f), residency.unloadedChunks);
+    ImGui::SliderInt("Unload Margin", &m_World->unloadMargin, 1, 16);
+    ImGui::Text("Pending Chunk Updates: %zu", m_World->GetPendingChunkUpdates());
+
+    World::UploadStats uploadStats = m_World->GetUploadStats();
+    ImGui::Text("Uploads: %d (%.1f KB, %.2f ms) | Deferred: %d", uploadStats.uploads, uploadStats.bytes / 1024.0f, uploadStats.milliseconds, uploadStats.deferred);
+    ImGui::SliderFloat("Upload Budget (ms)", &m_World->uploadBudgetMs, 0.25f, 8.0f);
 
 	ImGui::BeginGroup();
 	ImGui::SliderFloat("Fog Density", &m_FogDensity, 0.0f, 0.1f);
@@ -238,10 +284,39 @@ void Game::RenderImGui()
     ImGui::Text("FPS: %.1f", 1.0f / m_DeltaTime);
     ImGui::End();
 
+    if (m_ShowOcclusionBuffer)
+        RenderOcclusionBufferPreview();
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+void Game::RenderOcclusionBufferPreview()
+{
+    if (m_OcclusionTexture == 0)
+    {
+        glGenTextures(1, &m_OcclusionTexture);
+        glBindTexture(GL_TEXTURE_2D, m_OcclusionTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, OcclusionBuffer::WIDTH, OcclusionBuffer::HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    // Up to the occluder distance, that is as far as anything gets drawn into it
+    float maxDistance = (float)((m_World->occluderDistance + 1) * 16);
+    m_World->GetOcclusionBuffer().GetDebugImage(m_OcclusionPixels, maxDistance);
+
+    glBindTexture(GL_TEXTURE_2D, m_OcclusionTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, OcclusionBuffer::WIDTH, OcclusionBuffer::HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, m_OcclusionPixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    ImGui::Begin("Occlusion Buffer");
+    ImGui::Image((ImTextureID)(intptr_t)m_OcclusionTexture, ImVec2(OcclusionBuffer::WIDTH * 2.0f, OcclusionBuffer::HEIGHT * 2.0f));
+    ImGui::End();
+}
+
 void Game::Run()
 {
     while (!glfwWindowShouldClose(m_Window))
@@ -262,10 +337,18 @@ void Game::Run()
 
 void Game::Shutdown()
 {
+    if (m_OcclusionTexture != 0)
+        glDeleteTextures(1, &m_OcclusionTexture);
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
+    // The chunk meshes live in GL buffers of the worlds ChunkMeshArena and the renderer owns the quad index buffer,
+    // they have to go while the context still exists
+    m_World.reset();
+    m_Renderer.reset();
+
     if (m_Window)
     {
         glfwDestroyWindow(m_Window);
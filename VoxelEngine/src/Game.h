@@ -6,6 +6,7 @@
 #include <GLFW/glfw3.h>
 #include <glm.hpp>
 #include <memory>
+#include <vector>
 
 class Renderer;
 class Camera;
@@ -30,6 +31,7 @@ private:
     void Update(float deltaTime);
     void Render();
     void RenderImGui();
+    void RenderOcclusionBufferPreview();
     void Shutdown();
 
     GLFWwindow* m_Window;
@@ -49,6 +51,7 @@ private:
     std::unique_ptr<Shader> m_CutoutShader;
     std::unique_ptr<Shader> m_WaterShader;
     std::unique_ptr<Shader> m_FogShader;
+    std::unique_ptr<Shader> m_OutlineShader;
 
     std::unique_ptr<Texture> m_AtlasTexture;
 
@@ -70,6 +73,11 @@ private:
 
     bool m_CursorLocked = true;
 
+    // Debug view of the worlds OcclusionBuffer
+    bool m_ShowOcclusionBuffer = false;
+    unsigned int m_OcclusionTexture = 0;
+    std::vector<uint32_t> m_OcclusionPixels;
+
     float m_FogDensity = 0.015f;
 	float m_FogFalloff = 0.12f;
 	float m_FogHeight = 64.0f;
@@ -0,0 +1,141 @@
+#include "JobSystem.h"
+
+namespace
+{
+    // Index of the worker running on this thread, -1 on every other thread
+    thread_local int t_WorkerIndex = -1;
+}
+
+JobSystem::JobSystem(int threadCount)
+{
+    if (threadCount <= 0)
+    {
+        int hardwareThreads = (int)std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    for (int i = 0; i < threadCount; i++)
+        m_Queues.push_back(std::make_unique<WorkerQueue>());
+
+    // Queues first, workers steal from all of them as soon as they start
+    for (int i = 0; i < threadCount; i++)
+        m_Threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    Shutdown();
+}
+
+void JobSystem::Submit(Job job)
+{
+    // Workers keep their own jobs local, everyone else spreads them over all queues
+    int index = t_WorkerIndex >= 0 ? t_WorkerIndex : (int)(m_NextQueue++ % m_Queues.size());
+
+    // Counted before it is queued, a worker can take it right after the push and it must never go below 0
+    m_PendingJobs++;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Queues[index]->mutex);
+        m_Queues[index]->jobs.push_back(std::move(job));
+    }
+
+    // A worker counts itself as sleeping before it checks m_SubmitCount, and we check for sleepers after the increment.
+    // So either it sees the new count and stays awake, or we see it and wake it up.
+    m_SubmitCount++;
+    if (m_SleepingWorkers > 0)
+    {
+        // Taking the lock makes sure a worker that is about to wait is waiting before we notify
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_WakeUp.notify_one();
+    }
+}
+
+bool JobSystem::PopOrSteal(int workerIndex, Job& job, bool blocking)
+{
+    // Own queue, newest first. Its data is most likely still in cache
+    {
+        WorkerQueue& queue = *m_Queues[workerIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest job of another worker
+    int count = (int)m_Queues.size();
+    for (int i = 1; i < count; i++)
+    {
+        WorkerQueue& queue = *m_Queues[(workerIndex + i) % count];
+        std::unique_lock<std::mutex> lock(queue.mutex, std::defer_lock);
+        if (blocking)
+            lock.lock();
+        else if (!lock.try_lock())
+            continue;
+
+        if (!queue.jobs.empty())
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::WorkerLoop(int workerIndex)
+{
+    t_WorkerIndex = workerIndex;
+
+    while (true)
+    {
+        // Read before looking, a job submitted after this wakes us even if we miss it below
+        uint64_t submitCount = m_SubmitCount;
+
+        // A queue that is locked right now might hold a job, the second pass waits for the locks instead of skipping them
+        Job job;
+        if (PopOrSteal(workerIndex, job, false) || PopOrSteal(workerIndex, job, true))
+        {
+            // The last job of a shutdown lets the sleeping workers exit
+            if (--m_PendingJobs == 0 && m_ShutDown)
+            {
+                std::lock_guard<std::mutex> lock(m_SleepMutex);
+                m_WakeUp.notify_all();
+            }
+
+            job();
+            continue;
+        }
+
+        // Pending jobs we didnt find are being pushed or were just taken by another worker, no reason to spin on them
+        std::unique_lock<std::mutex> lock(m_SleepMutex);
+        m_SleepingWorkers++;
+        m_WakeUp.wait(lock, [&] { return m_SubmitCount != submitCount || (m_ShutDown && m_PendingJobs == 0); });
+        m_SleepingWorkers--;
+
+        if (m_ShutDown && m_PendingJobs == 0)
+            return;
+    }
+}
+
+void JobSystem::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        if (m_ShutDown)
+            return;
+        m_ShutDown = true;
+    }
+    m_WakeUp.notify_all();
+
+    for (auto& thread : m_Threads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+    m_Threads.clear();
+}
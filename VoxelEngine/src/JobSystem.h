@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/*
+* Move only void() callable. Callables up to INLINE_SIZE bytes (a mesh job with its snapshots fits) are stored inside the job,
+* bigger ones go to the heap. Unlike std::function this never allocates for the jobs we actually submit.
+*/
+class Job
+{
+public:
+	static constexpr size_t INLINE_SIZE = 112;
+
+private:
+	struct Ops {
+		void (*invoke)(void* storage);
+		void (*move)(void* from, void* to);	// Move constructs into to and destroys from
+		void (*destroy)(void* storage);
+	};
+
+	alignas(std::max_align_t) unsigned char m_Storage[INLINE_SIZE];
+	const Ops* m_Ops = nullptr;
+
+	template<typename F>
+	static constexpr bool IsInline = sizeof(F) <= INLINE_SIZE && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+	template<typename F>
+	static const Ops* GetOps()
+	{
+		if constexpr (IsInline<F>)
+		{
+			static const Ops ops = {
+				[](void* s) { (*static_cast<F*>(s))(); },
+				[](void* from, void* to) { new (to) F(std::move(*static_cast<F*>(from))); static_cast<F*>(from)->~F(); },
+				[](void* s) { static_cast<F*>(s)->~F(); }
+			};
+			return &ops;
+		}
+		else
+		{
+			// Storage only holds a pointer to the callable
+			static const Ops ops = {
+				[](void* s) { (**static_cast<F**>(s))(); },
+				[](void* from, void* to) { *static_cast<F**>(to) = *static_cast<F**>(from); },
+				[](void* s) { delete *static_cast<F**>(s); }
+			};
+			return &ops;
+		}
+	}
+
+public:
+	Job() = default;
+
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Job>>>
+	Job(F&& fn)
+	{
+		using Fn = std::decay_t<F>;
+		if constexpr (IsInline<Fn>)
+			new (m_Storage) Fn(std::forward<F>(fn));
+		else
+			*reinterpret_cast<Fn**>(m_Storage) = new Fn(std::forward<F>(fn));
+		m_Ops = GetOps<Fn>();
+	}
+
+	Job(Job&& other) noexcept : m_Ops(other.m_Ops)
+	{
+		if (m_Ops)
+			m_Ops->move(other.m_Storage, m_Storage);
+		other.m_Ops = nullptr;
+	}
+
+	Job& operator=(Job&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			m_Ops = other.m_Ops;
+			if (m_Ops)
+				m_Ops->move(other.m_Storage, m_Storage);
+			other.m_Ops = nullptr;
+		}
+		return *this;
+	}
+
+	Job(const Job&) = delete;
+	Job& operator=(const Job&) = delete;
+
+	~Job() { Reset(); }
+
+	void Reset()
+	{
+		if (m_Ops)
+			m_Ops->destroy(m_Storage);
+		m_Ops = nullptr;
+	}
+
+	explicit operator bool() const { return m_Ops != nullptr; }
+	void operator()() { m_Ops->invoke(m_Storage); }
+};
+
+/*
+* Work stealing thread pool.
+* Every worker has its own deque. Workers push and pop their own jobs at the back and steal from the front of the others,
+* so there is no single lock all threads fight over. Jobs submitted from outside (the main thread) are spread round robin.
+* Idle workers sleep until new jobs arrive, while nobody sleeps submitting a job doesnt touch any shared lock.
+* On shutdown the workers finish every queued job before they exit.
+*/
+class JobSystem
+{
+private:
+	struct alignas(64) WorkerQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> m_Queues;
+	std::vector<std::thread> m_Threads;
+
+	std::atomic<int> m_PendingJobs{ 0 };	// Queued and not yet taken by a worker
+	std::atomic<uint64_t> m_SubmitCount{ 0 };	// Sleeping workers wait for it to change
+	std::atomic<int> m_SleepingWorkers{ 0 };	// Submit only locks m_SleepMutex and notifies if there are any
+	std::atomic<unsigned int> m_NextQueue{ 0 };
+	std::atomic<bool> m_ShutDown{ false };
+
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WakeUp;
+
+	// Without blocking a queue another thread holds is skipped, blocking waits for it
+	bool PopOrSteal(int workerIndex, Job& job, bool blocking);
+	void WorkerLoop(int workerIndex);
+
+public:
+	// threadCount 0 = one worker per hardware thread, minus the main thread
+	explicit JobSystem(int threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	void Submit(Job job);
+
+	// Runs everything that is still queued and joins the workers. Called by the destructor as well.
+	void Shutdown();
+
+	int GetThreadCount() const { return (int)m_Queues.size(); }
+	int GetPendingJobs() const { return m_PendingJobs; }
+};
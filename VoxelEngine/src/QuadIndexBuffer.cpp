@@ -0,0 +1,75 @@
+#include "QuadIndexBuffer.h"
+
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include "Renderer.h"
+
+QuadIndexBuffer::~QuadIndexBuffer()
+{
+    if (m_ShortBuffer) glDeleteBuffers(1, &m_ShortBuffer);
+    if (m_IntBuffer) glDeleteBuffers(1, &m_IntBuffer);
+}
+
+void QuadIndexBuffer::Upload(unsigned int& buffer, unsigned int quadCount, bool shortIndices)
+{
+    if (!buffer)
+    {
+        GLCall(glGenBuffers(1, &buffer));
+    }
+
+    // The caller has a VAO bound, so this also attaches the buffer to it
+    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer));
+
+    if (shortIndices)
+    {
+        std::vector<uint16_t> indices(quadCount * 6);
+        for (unsigned int i = 0; i < quadCount; i++)
+        {
+            uint16_t base = (uint16_t)(i * 4);
+            uint16_t quad[6] = { base, (uint16_t)(base + 1), (uint16_t)(base + 2), (uint16_t)(base + 2), (uint16_t)(base + 3), base };
+            std::copy(quad, quad + 6, indices.begin() + i * 6);
+        }
+        GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW));
+    }
+    else
+    {
+        std::vector<uint32_t> indices(quadCount * 6);
+        for (unsigned int i = 0; i < quadCount; i++)
+        {
+            uint32_t base = i * 4;
+            uint32_t quad[6] = { base, base + 1, base + 2, base + 2, base + 3, base };
+            std::copy(quad, quad + 6, indices.begin() + i * 6);
+        }
+        GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW));
+    }
+}
+
+unsigned int QuadIndexBuffer::Bind(unsigned int quadCount)
+{
+    if (quadCount <= MAX_SHORT_QUADS)
+    {
+        // Grow at least 2x so a few bigger meshes in a row don't each cause a new upload
+        if (quadCount > m_ShortQuadCount)
+        {
+            m_ShortQuadCount = std::min(std::max(quadCount, m_ShortQuadCount * 2), MAX_SHORT_QUADS);
+            Upload(m_ShortBuffer, m_ShortQuadCount, true);
+        }
+        else
+        {
+            GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ShortBuffer));
+        }
+        return GL_UNSIGNED_SHORT;
+    }
+
+    if (quadCount > m_IntQuadCount)
+    {
+        m_IntQuadCount = std::max(quadCount, m_IntQuadCount * 2);
+        Upload(m_IntBuffer, m_IntQuadCount, false);
+    }
+    else
+    {
+        GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IntBuffer));
+    }
+    return GL_UNSIGNED_INT;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+* Index buffer for meshes made of quads, 4 vertices per quad drawn as 0 1 2 2 3 0.
+* The pattern is the same for every chunk mesh, so all of them share this buffer instead of uploading their own.
+* It grows when a mesh with more quads than it currently covers is drawn.
+* Meshes with at most MAX_SHORT_QUADS quads use 16-bit indices, bigger ones a separate 32-bit buffer.
+*/
+class QuadIndexBuffer
+{
+private:
+	unsigned int m_ShortBuffer = 0;
+	unsigned int m_ShortQuadCount = 0;
+
+	unsigned int m_IntBuffer = 0;
+	unsigned int m_IntQuadCount = 0;
+
+	static void Upload(unsigned int& buffer, unsigned int quadCount, bool shortIndices);
+
+public:
+	// Every vertex index of the mesh has to fit into 16 bits
+	static constexpr unsigned int MAX_SHORT_QUADS = 65536 / 4;
+
+	QuadIndexBuffer() = default;
+	~QuadIndexBuffer();
+
+	QuadIndexBuffer(const QuadIndexBuffer&) = delete;
+	QuadIndexBuffer& operator=(const QuadIndexBuffer&) = delete;
+
+	// Binds a buffer covering at least quadCount quads to the current VAO and returns its index type (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT)
+	unsigned int Bind(unsigned int quadCount);
+};
@@ -4,6 +4,7 @@
 
 #include "VertexArray.h"
 #include "IndexBuffer.h"
+#include "QuadIndexBuffer.h"
 #include "Shader.h"
 #include "world/Skybox.h"
 
@@ -30,9 +31,13 @@ private:
 	unsigned int m_QuadVAO = 0;
 	unsigned int m_QuadVBO = 0;
 
+	QuadIndexBuffer m_QuadIndexBuffer;
+
 public:
     void Clear() const;
     void Draw(const VertexArray& va, const IndexBuffer& ib, const Shader& shader) const;
+	// Binds the shared quad index buffer to the bound VAO for draws of up to quadCount quads, returns the index type
+	unsigned int BindQuadIndices(unsigned int quadCount) { return m_QuadIndexBuffer.Bind(quadCount); }
 	void DrawSkybox(const Skybox& skybox, const glm::mat4& view, const glm::mat4& proj) const;
 
 	void BeginGeometryPass() const {};
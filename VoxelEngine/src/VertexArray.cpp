@@ -22,11 +22,25 @@ void VertexArray::AddBuffer(const VertexBuffer& vb, const VertexBufferLayout& la
 	for (unsigned int i = 0; i < elements.size(); i++)
 	{
 		const auto& element = elements[i];
-		GLCall(glEnableVertexAttribArray(i));
-		GLCall(glVertexAttribPointer(i, element.count, element.type, element.normalized,
-			layout.GetStride(), (const void*) offset));
+		unsigned int location = m_AttributeCount + i;
+		GLCall(glEnableVertexAttribArray(location));
+		if (element.integer)
+		{
+			GLCall(glVertexAttribIPointer(location, element.count, element.type,
+				layout.GetStride(), (const void*) offset));
+		}
+		else
+		{
+			GLCall(glVertexAttribPointer(location, element.count, element.type, element.normalized,
+				layout.GetStride(), (const void*) offset));
+		}
+		if (element.divisor)
+		{
+			GLCall(glVertexAttribDivisor(location, element.divisor));
+		}
 		offset += element.count * VertexBufferElement::GetSizeOfType(element.type);
 	}
+	m_AttributeCount += (unsigned int)elements.size();
 }
 
 void VertexArray::Bind() const
@@ -8,6 +8,7 @@ class VertexArray
 {
 private:
 	unsigned int m_RendererID;
+	unsigned int m_AttributeCount = 0; // Each AddBuffer continues at the next attribute location
 
 public:
 	VertexArray();
@@ -4,10 +4,20 @@ class VertexBuffer
 {
 private:
 	unsigned int m_RendererID;
+	bool m_Dynamic;
 public:
-	VertexBuffer(const void* data, unsigned int size);
+	// Dynamic buffers are written often (GL_DYNAMIC_DRAW), static ones once
+	VertexBuffer(const void* data, unsigned int size, bool dynamic = false);
 	~VertexBuffer();
 	
 	void Bind() const;
 	void Unbind() const;
+
+	// Overwrites size bytes at offset, the buffer keeps its size
+	void SetSubData(unsigned int offset, const void* data, unsigned int size);
+
+	// Replaces the whole buffer, size can change
+	void SetData(const void* data, unsigned int size);
+
+	unsigned int GetRendererID() const { return m_RendererID; }
 };
\ No newline at end of file
@@ -9,6 +9,8 @@ struct VertexBufferElement
 	unsigned int type;
 	unsigned int count;
 	unsigned char normalized;
+	bool integer = false; // Passed to the shader as int/uint instead of being converted to float
+	unsigned int divisor = 0; // 1 = advances once per instance instead of once per vertex
 
 	static unsigned int GetSizeOfType(unsigned int type)
 	{
@@ -60,6 +62,34 @@ public:
 		m_Stride += VertexBufferElement::GetSizeOfType(GL_UNSIGNED_BYTE) * count;
 	}
 
+	// Integer attributes (glVertexAttribIPointer), for packed data that the shader decodes itself
+	template<typename T>
+	void PushInteger(unsigned int count)
+	{
+		static_assert(false);
+	}
+
+	template<>
+	void PushInteger<unsigned int>(unsigned int count)
+	{
+		m_Elements.push_back({ GL_UNSIGNED_INT, count, GL_FALSE, true });
+		m_Stride += VertexBufferElement::GetSizeOfType(GL_UNSIGNED_INT) * count;
+	}
+
+	// Per instance attributes (divisor 1). With baseInstance every draw of a multi draw can read its own value.
+	template<typename T>
+	void PushPerInstance(unsigned int count)
+	{
+		static_assert(false);
+	}
+
+	template<>
+	void PushPerInstance<float>(unsigned int count)
+	{
+		m_Elements.push_back({ GL_FLOAT, count, GL_FALSE, false, 1 });
+		m_Stride += VertexBufferElement::GetSizeOfType(GL_FLOAT) * count;
+	}
+
 	inline const std::vector<VertexBufferElement> GetElements() const& { return m_Elements; }
 	inline unsigned int GetStride() const { return m_Stride; }
 };
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "BlockStorage.h"
+
+BlockStorage::BlockStorage(int volume, BlockType fill) : m_Volume(volume), m_BitsPerEntry(0), m_Mask(0)
+{
+    m_Palette.push_back(fill);
+}
+
+int BlockStorage::GetOrAddPaletteIndex(BlockType type)
+{
+    // Palettes are tiny (a handful of entries) so a linear search is faster than any map
+    for (int i = 0; i < (int)m_Palette.size(); i++)
+    {
+        if (m_Palette[i] == type)
+            return i;
+    }
+
+    m_Palette.push_back(type);
+
+    // Palette outgrew the current index width, so we repack into the next bigger one
+    if ((int)m_Palette.size() > (1 << m_BitsPerEntry))
+    {
+        int bits = m_BitsPerEntry == 0 ? 1 : m_BitsPerEntry * 2;
+        Resize(bits);
+    }
+
+    return (int)m_Palette.size() - 1;
+}
+
+void BlockStorage::Resize(int bitsPerEntry)
+{
+    std::vector<uint64_t> newData;
+
+    if (bitsPerEntry > 0)
+    {
+        int entriesPerWord = 64 / bitsPerEntry;
+        newData.resize((m_Volume + entriesPerWord - 1) / entriesPerWord, 0);
+
+        uint64_t newMask = (1ull << bitsPerEntry) - 1;
+        for (int i = 0; i < m_Volume; i++)
+        {
+            uint64_t paletteIndex = m_BitsPerEntry == 0 ? 0 : (uint64_t)GetIndex(i);
+            int bit = i * bitsPerEntry;
+            newData[bit >> 6] |= (paletteIndex & newMask) << (bit & 63);
+        }
+        m_Mask = newMask;
+    }
+    else
+    {
+        m_Mask = 0;
+    }
+
+    m_Data = std::move(newData);
+    m_BitsPerEntry = bitsPerEntry;
+}
+
+void BlockStorage::Set(int index, BlockType type)
+{
+    if (m_BitsPerEntry == 0 && m_Palette[0] == type)
+        return;
+
+    int paletteIndex = GetOrAddPaletteIndex(type);
+    SetIndex(index, paletteIndex);
+}
+
+void BlockStorage::Unpack(int index, int count, BlockType* out) const
+{
+    if (m_BitsPerEntry == 0)
+    {
+        for (int i = 0; i < count; i++)
+            out[i] = m_Palette[0];
+        return;
+    }
+
+    // Walk the words directly instead of recomputing the bit position for every entry
+    int bit = index * m_BitsPerEntry;
+    int word = bit >> 6;
+    int shift = bit & 63;
+    uint64_t data = m_Data[word] >> shift;
+
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = m_Palette[data & m_Mask];
+        shift += m_BitsPerEntry;
+        data >>= m_BitsPerEntry;
+
+        if (shift == 64 && i + 1 < count)
+        {
+            shift = 0;
+            data = m_Data[++word];
+        }
+    }
+}
+
+void BlockStorage::Compact()
+{
+    if (m_BitsPerEntry == 0)
+        return;
+
+    // Find which palette entries are still referenced
+    std::vector<int> remap(m_Palette.size(), -1);
+    for (int i = 0; i < m_Volume; i++)
+        remap[GetIndex(i)] = 0;
+
+    std::vector<BlockType> newPalette;
+    for (int i = 0; i < (int)m_Palette.size(); i++)
+    {
+        if (remap[i] != -1)
+        {
+            remap[i] = (int)newPalette.size();
+            newPalette.push_back(m_Palette[i]);
+        }
+    }
+
+    if (newPalette.size() == m_Palette.size())
+        return;
+
+    int bits = 0;
+    while ((1 << bits) < (int)newPalette.size())
+        bits = bits == 0 ? 1 : bits * 2;
+
+    std::vector<uint64_t> newData;
+    uint64_t newMask = bits == 0 ? 0 : (1ull << bits) - 1;
+
+    if (bits > 0)
+    {
+        int entriesPerWord = 64 / bits;
+        newData.resize((m_Volume + entriesPerWord - 1) / entriesPerWord, 0);
+
+        for (int i = 0; i < m_Volume; i++)
+        {
+            int bit = i * bits;
+            newData[bit >> 6] |= (uint64_t)remap[GetIndex(i)] << (bit & 63);
+        }
+    }
+
+    m_Palette = std::move(newPalette);
+    m_Data = std::move(newData);
+    m_BitsPerEntry = bits;
+    m_Mask = newMask;
+}
+
+size_t BlockStorage::GetMemoryUsage() const
+{
+    return sizeof(BlockStorage) + m_Palette.capacity() * sizeof(BlockType) + m_Data.capacity() * sizeof(uint64_t);
+}
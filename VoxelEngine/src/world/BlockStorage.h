@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Block.h"
+
+/*
+* Palette compressed block storage.
+*
+* Instead of storing a full 4 byte BlockType per voxel, we keep a small palette of the distinct block types
+* and store a bit packed index into that palette per voxel. The index width depends on how many different
+* blocks are stored: 1 type = 0 bits (no data at all), 2 = 1 bit, 4 = 2 bits, 16 = 4 bits, 256 = 8 bits.
+* The widths all divide 64, so an index never crosses a word boundary and reading one is a shift and a mask.
+*
+* A typical terrain chunk (Air, Stone, Dirt, Grass, Water) fits into 4 bits, a chunk with only 4 types into 2 bits.
+*/
+class BlockStorage
+{
+private:
+	int m_Volume;
+	int m_BitsPerEntry;
+	uint64_t m_Mask;
+
+	std::vector<BlockType> m_Palette;
+	std::vector<uint64_t> m_Data;
+
+	int GetOrAddPaletteIndex(BlockType type);
+	void Resize(int bitsPerEntry);
+
+	inline int GetIndex(int index) const
+	{
+		int bit = index * m_BitsPerEntry;
+		return (int)((m_Data[bit >> 6] >> (bit & 63)) & m_Mask);
+	}
+
+	inline void SetIndex(int index, int paletteIndex)
+	{
+		int bit = index * m_BitsPerEntry;
+		uint64_t& word = m_Data[bit >> 6];
+		word = (word & ~(m_Mask << (bit & 63))) | ((uint64_t)paletteIndex << (bit & 63));
+	}
+
+public:
+	explicit BlockStorage(int volume, BlockType fill = BlockType::AIR);
+
+	inline BlockType Get(int index) const
+	{
+		// Uniform storage (for example a chunk that is only air) has no data at all
+		if (m_BitsPerEntry == 0)
+			return m_Palette[0];
+		return m_Palette[GetIndex(index)];
+	}
+
+	void Set(int index, BlockType type);
+
+	// Unpacks count consecutive entries starting at index into out
+	void Unpack(int index, int count, BlockType* out) const;
+
+	// Drops palette entries that are no longer used and shrinks the index width if possible
+	void Compact();
+
+	int GetVolume() const { return m_Volume; }
+	int GetBitsPerEntry() const { return m_BitsPerEntry; }
+	int GetPaletteSize() const { return (int)m_Palette.size(); }
+	bool IsUniform() const { return m_BitsPerEntry == 0; }
+
+	size_t GetMemoryUsage() const;
+};
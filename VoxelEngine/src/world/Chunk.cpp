@@ -2,32 +2,22 @@
 #include "Block.h"
 #include "../VertexBufferLayout.h"
 #include <iostream>
+#include <algorithm>
 #include "../vendor/FastNoiseLite.h"
 
 #include "World.h"
+#include "MeshBufferPool.h"
 
 
-Chunk::Chunk(glm::ivec2 position) : m_ChunkPosition(position), m_VA(nullptr), m_VB(nullptr), m_IB(nullptr),
-m_WaterVA(nullptr), m_WaterVB(nullptr), m_WaterIB(nullptr)
+Chunk::Chunk(glm::ivec2 position) : m_ChunkPosition(position), m_Blocks(std::make_shared<ChunkData>())
 {
     
 }
 
-Chunk::~Chunk()
-{
-    delete m_VA;
-    delete m_VB;
-    delete m_IB;
-
-    delete m_WaterVA;
-    delete m_WaterVB;
-    delete m_WaterIB;
-}
-
 BlockType Chunk::GetBlockTypeFromData(const ChunkData& data, int x, int y, int z)
 {
     if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT && z >= 0 && z < WIDTH)
-        return data.blocks[x][y][z].GetType();
+        return data.Get(x, y, z);
     return BlockType::AIR;
 }
 
@@ -44,649 +34,921 @@ BlockType Chunk::GetBlockTypeFromData(const PaddedChunkData& data, int x, int y,
     return BlockType::AIR;;
 }
 
-// TODO, check across chunk boundaries
-void Chunk::CreateBlockWorker(const ChunkData& data, glm::ivec2 chunkPos, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, int x, int y, int z)
+namespace
 {
-    // Air is not a real block so we skip it
-    BlockType blockType = GetBlockTypeFromData(data, x, y, z);
-    if (blockType == BlockType::AIR) return;
+    // Face data: positions and UV relative to the block center, AO (experimental)
+    struct FaceVertex {
+        float x, y, z, u, v, ao;
+    };
 
-    bool renderFront = !IsSolid(GetBlockTypeFromData(data, x, y, z + 1));
-    bool renderBack = !IsSolid(GetBlockTypeFromData(data, x, y, z - 1));
-    bool renderLeft = !IsSolid(GetBlockTypeFromData(data, x - 1, y, z));
-    bool renderRight = !IsSolid(GetBlockTypeFromData(data, x + 1, y, z));
-    bool renderTop = !IsSolid(GetBlockTypeFromData(data, x, y + 1, z));
-    bool renderBottom = !IsSolid(GetBlockTypeFromData(data, x, y - 1, z));
+    // Same order as Chunk::Face
+    const FaceVertex FACE_VERTICES[6][4] = {
+        // Front face (+Z)
+        { {-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f}, { 0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 1.0f}, { 0.5f,  0.5f, 0.5f, 1.0f, 1.0f, 0.0f}, {-0.5f,  0.5f, 0.5f, 0.0f, 1.0f, 0.0f} },
+        // Back face (-Z)
+        { { 0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f}, {-0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f}, {-0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f}, { 0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f} },
+        // Left face (-X)
+        { {-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f}, {-0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 1.0f}, {-0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 0.0f}, {-0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f} },
+        // Right face (+X)
+        { {0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f}, {0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f}, {0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f}, {0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f} },
+        // Top face (+Y)
+        { {-0.5f, 0.5f,  0.5f, 0.0f, 0.0f, 0.0f}, { 0.5f, 0.5f,  0.5f, 1.0f, 0.0f, 0.0f}, { 0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f}, {-0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f} },
+        // Bottom face (-Y)
+        { {-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f}, { 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f}, { 0.5f, -0.5f,  0.5f, 1.0f, 1.0f, 0.0f}, {-0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 0.0f} }
+    };
+}
 
-    // Skip if all faces are hdden
-    if (!renderFront && !renderBack && !renderLeft &&
-        !renderRight && !renderTop && !renderBottom) {
-        return;
-    }
+void Chunk::EmitQuad(std::vector<Vertex>& vertices,
+    BlockType blockType, int face, glm::ivec3 start, glm::ivec3 size)
+{
+    // Every block has its own atlas tile in the bottom row, top faces use the row above
+    uint32_t tileX = blockType - 1;
+    uint32_t tileY = face == FACE_TOP ? 30 : 31;
+    uint32_t tile = tileY * 32 + tileX;
 
-    float tileSize = 1.0f / 32.0f;
-    int tileX = 0 + blockType - 1;
-    int tileY = 31;
+    // int lightLevel = GetLightLevelAt(x, y, z, data);
+    uint32_t lightLevel = 15;
 
-	// float lightLevel = GetLightLevelAt(x, y, z, data);
-    float lightLevel = 1;
+    // The texture repeats once per block, so UVs are scaled by how many blocks the quad covers
+    int uSize = face == FACE_LEFT || face == FACE_RIGHT ? size.z : size.x;
+    int vSize = face == FACE_TOP || face == FACE_BOTTOM ? size.z : size.y;
 
-    // Face data: positions, UV, AO, LightLevel (experimental)
-    struct FaceVertex {
-        float x, y, z, u, v, ao, lightLevel;
+    for (const FaceVertex& vert : FACE_VERTICES[face])
+    {
+        // Block corners, min side of the first block or max side of the last block. The shader moves them by -0.5 and the chunk origin
+        int x = vert.x < 0 ? start.x : start.x + size.x;
+        int y = vert.y < 0 ? start.y : start.y + size.y;
+        int z = vert.z < 0 ? start.z : start.z + size.z;
+
+        vertices.emplace_back(
+            x, y, z,
+            (uint32_t)(vert.ao * 3),
+            lightLevel,
+            tile,
+            (uint32_t)(vert.u * uSize),
+            (uint32_t)(vert.v * vSize)
+        );
+    }
+
+}
+
+void Chunk::BuildColumnMasks(const PaddedChunkData& data, int minY, int maxY, ColumnMasks& columns)
+{
+    // Block flags, so building the masks is branch free
+    constexpr int BLOCK_TYPE_COUNT = 8;
+    static const uint64_t isOpaque[BLOCK_TYPE_COUNT] = {
+        IsSolid(AIR), IsSolid(GRASS), IsSolid(STONE), IsSolid(WOOD), IsSolid(LEAF), IsSolid(WATER), IsSolid(DIRT), IsSolid(SAND)
     };
 
-    // PRECOMPUTE
-    float wx = x + chunkPos.x * WIDTH;
-    float wy = y;
-    float wz = z + chunkPos.y * WIDTH;
-
-    // Front face (+Z)
-    if (renderFront) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex frontFace[] = {
-            {-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, lightLevel},
-            { 0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 1.0f, lightLevel},
-            { 0.5f,  0.5f, 0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {-0.5f,  0.5f, 0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+    for (int x = 0; x < WIDTH + 2; x++)
+    {
+        for (int z = 0; z < WIDTH + 2; z++)
+        {
+            uint64_t opaque[2] = { 0, 0 };
+            uint64_t solid[2] = { 0, 0 };
+            uint64_t water[2] = { 0, 0 };
 
-        for (const auto& vert : frontFace) {
-            vertices.emplace_back(
-                    vert.x + x + chunkPos.x * WIDTH,
-                    vert.y + y,
-                    vert.z + z + chunkPos.y * WIDTH,
-                    (tileX + vert.u) * tileSize,
-                    (tileY + vert.v) * tileSize,
-                    vert.ao,
-                    vert.lightLevel
-                );
-        }
+            for (int y = minY; y < maxY; y++)
+            {
+                BlockType type = data.blocks[x][y][z].GetType();
+                int word = y >> 6;
+                int bit = y & 63;
+
+                opaque[word] |= isOpaque[type] << bit;
+                solid[word] |= (uint64_t)(type != BlockType::AIR && type != BlockType::WATER) << bit;
+                water[word] |= (uint64_t)(type == BlockType::WATER) << bit;
+            }
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
+            columns.opaque[x][z] = { opaque[0], opaque[1] };
+            columns.solid[x][z] = { solid[0], solid[1] };
+            columns.water[x][z] = { water[0], water[1] };
+        }
     }
+}
 
-    // Back face (-Z)
-    if (renderBack) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex backFace[] = {
-            { 0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, lightLevel},
-            {-0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f, lightLevel},
-            {-0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            { 0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+/*
+* A face is visible when the block is there and the neighbor in that direction is not opaque.
+* With one mask per column that is a single AND NOT per column and direction. Up and down neighbors are the same column shifted by one.
+* Water additionally hides faces towards other water, except for the bottom face.
+*/
+void Chunk::BuildFaceMasks(const ColumnMasks& columns, const ColumnMask& meshedRange, FaceMasks& faces)
+{
+    for (int x = 0; x < WIDTH; x++)
+    {
+        for (int z = 0; z < WIDTH; z++)
+        {
+            // Padded coordinates of this column
+            int px = x + 1;
+            int pz = z + 1;
+
+            const ColumnMask& opaque = columns.opaque[px][pz];
+            ColumnMask solid = columns.solid[px][pz] & meshedRange;
+            ColumnMask water = columns.water[px][pz] & meshedRange;
+
+            const ColumnMask* neighborOpaque[4] = {
+                &columns.opaque[px][pz + 1], &columns.opaque[px][pz - 1], &columns.opaque[px - 1][pz], &columns.opaque[px + 1][pz]
+            };
+            const ColumnMask* neighborWater[4] = {
+                &columns.water[px][pz + 1], &columns.water[px][pz - 1], &columns.water[px - 1][pz], &columns.water[px + 1][pz]
+            };
+
+            // FRONT, BACK, LEFT, RIGHT
+            for (int face = 0; face < 4; face++)
+            {
+                faces.solid[face][x][z] = AndNot(solid, *neighborOpaque[face]);
+                faces.water[face][x][z] = AndNot(water, *neighborOpaque[face] | *neighborWater[face]);
+            }
 
-        for (const auto& vert : backFace) {
-            vertices.emplace_back(
-                    vert.x + x + chunkPos.x * WIDTH,
-                    vert.y + y,
-                    vert.z + z + chunkPos.y * WIDTH,
-                    (tileX + vert.u) * tileSize,
-                    (tileY + vert.v) * tileSize,
-                    vert.ao,
-                    vert.lightLevel
-                );
+            ColumnMask above = ShiftDown(opaque);
+            ColumnMask below = ShiftUp(opaque);
+
+            // Nobody looks at the world from below, the bottom faces of y = 0 would only stretch the chunk bounds down to 0
+            below.lo |= 1;
+
+            faces.solid[FACE_TOP][x][z] = AndNot(solid, above);
+            faces.solid[FACE_BOTTOM][x][z] = AndNot(solid, below);
+
+            faces.water[FACE_TOP][x][z] = AndNot(water, above | ShiftDown(columns.water[px][pz]));
+            faces.water[FACE_BOTTOM][x][z] = AndNot(water, below);
         }
+    }
+}
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
+void Chunk::EmitFaces(const PaddedChunkData& data, const ColumnMask (&faces)[FACE_COUNT][WIDTH][WIDTH], const ColumnMask& range,
+    std::vector<Vertex>& vertices)
+{
+    for (int face = 0; face < FACE_COUNT; face++)
+    {
+        for (int x = 0; x < WIDTH; x++)
+        {
+            for (int z = 0; z < WIDTH; z++)
+            {
+                // Only visible faces are visited, everything else was already thrown away by the masks
+                (faces[face][x][z] & range).ForEachBit([&](int y) {
+                    BlockType type = data.blocks[x + 1][y][z + 1].GetType();
+                    EmitQuad(vertices, type, face, { x, y, z }, { 1, 1, 1 });
+                });
+            }
+        }
     }
 
-    // Left face (-X)
-    if (renderLeft) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex leftFace[] = {
-            {-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, lightLevel},
-            {-0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 1.0f, lightLevel},
-            {-0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {-0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+    // TODO: Only apply AO when their is a block below or below + front direction, Check for front, back left, right. But how would this work across chunk boundaries and performance wise.
+}
+
+/*
+* Greedy meshing for the solid layer.
+* For every Y layer and face direction we build a 16x16 mask of visible faces and then merge neighboring faces with the same block
+* into one bigger quad. Top and bottom faces are merged in both directions, side faces only horizontally since their AO
+* goes from the bottom to the top of a single block and would get stretched otherwise.
+*/
+void Chunk::GreedyMeshLayer(const PaddedChunkData& data, const FaceMasks& faces, std::vector<Vertex>& vertices, int y)
+{
+    // mask[j][i]: i is the axis we always merge along (x, or z for the X faces), j the other horizontal axis
+    BlockType mask[WIDTH][WIDTH];
 
-        for (const auto& vert : leftFace) {
-            vertices.emplace_back(
-                    vert.x + x + chunkPos.x * WIDTH,
-                    vert.y + y,
-                    vert.z + z + chunkPos.y * WIDTH,
-                    (tileX + vert.u) * tileSize,
-                    (tileY + vert.v) * tileSize,
-                    vert.ao,
-                    vert.lightLevel
-                );
+    for (int face = 0; face < FACE_COUNT; face++)
+    {
+        bool xFace = face == FACE_LEFT || face == FACE_RIGHT;
+        bool mergeJ = face == FACE_TOP || face == FACE_BOTTOM;
+
+        bool hasFaces = false;
+        for (int j = 0; j < WIDTH; j++)
+        {
+            for (int i = 0; i < WIDTH; i++)
+            {
+                int x = xFace ? j : i;
+                int z = xFace ? i : j;
+
+                bool visible = faces.solid[face][x][z].Test(y);
+                mask[j][i] = visible ? data.blocks[x + 1][y][z + 1].GetType() : BlockType::AIR;
+                hasFaces |= visible;
+            }
         }
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
-    }
+        if (!hasFaces) continue;
 
-    // Right face (+X)
-    if (renderRight) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex rightFace[] = {
-            {0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f, lightLevel},
-            {0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f, lightLevel},
-            {0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+        for (int j = 0; j < WIDTH; j++)
+        {
+            for (int i = 0; i < WIDTH;)
+            {
+                BlockType type = mask[j][i];
+                if (type == BlockType::AIR) { i++; continue; }
+
+                int w = 1;
+                while (i + w < WIDTH && mask[j][i + w] == type) w++;
+
+                int h = 1;
+                if (mergeJ)
+                {
+                    while (j + h < WIDTH)
+                    {
+                        bool rowMatches = true;
+                        for (int k = i; k < i + w; k++)
+                        {
+                            if (mask[j + h][k] != type) { rowMatches = false; break; }
+                        }
+                        if (!rowMatches) break;
+                        h++;
+                    }
+                }
+
+                for (int jj = j; jj < j + h; jj++)
+                    for (int ii = i; ii < i + w; ii++)
+                        mask[jj][ii] = BlockType::AIR;
 
-        for (const auto& vert : rightFace) {
-            vertices.emplace_back(
-                    vert.x + x + chunkPos.x * WIDTH,
-                    vert.y + y,
-                    vert.z + z + chunkPos.y * WIDTH,
-                    (tileX + vert.u) * tileSize,
-                    (tileY + vert.v) * tileSize,
-                    vert.ao,
-                    vert.lightLevel
-                );
+                glm::ivec3 start = xFace ? glm::ivec3(j, y, i) : glm::ivec3(i, y, j);
+                glm::ivec3 size = xFace ? glm::ivec3(1, 1, w) : glm::ivec3(w, 1, h);
+
+                EmitQuad(vertices, type, face, start, size);
+                i += w;
+            }
         }
+    }
+}
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
+void Chunk::ChunkSection::Set(int x, int ly, int z, BlockType type)
+{
+    int index = Index(x, ly, z);
+    BlockType old = storage.Get(index);
+    if (old == type) return;
+
+    nonAirCount += (type != BlockType::AIR) - (old != BlockType::AIR);
+    solidCount += IsSolid(type) - IsSolid(old);
+    storage.Set(index, type);
+}
+
+void Chunk::ChunkData::Set(int x, int y, int z, BlockType type)
+{
+    std::shared_ptr<ChunkSection>& section = sections[y / SECTION_SIZE];
+
+    if (!section)
+    {
+        if (type == BlockType::AIR) return;
+        section = std::make_shared<ChunkSection>();
+    }
+    else if (section.use_count() > 1)
+    {
+        // Shared with an older snapshot, copy-on-write
+        section = std::make_shared<ChunkSection>(*section);
     }
 
-    // Top face (+Y)
-    if (renderTop) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex topFace[] = {
-            {-0.5f, 0.5f,  0.5f, 0.0f, 0.0f, 0.0f, lightLevel},
-            { 0.5f, 0.5f,  0.5f, 1.0f, 0.0f, 0.0f, lightLevel},
-            { 0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {-0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+    section->Set(x, y % SECTION_SIZE, z, type);
 
-        for (const auto& vert : topFace) {
-            vertices.emplace_back(
-                    vert.x + x + chunkPos.x * WIDTH,
-                    vert.y + y,
-                    vert.z + z + chunkPos.y * WIDTH,
-                    (tileX + vert.u) * tileSize,
-                    (tileY + -1 + vert.v) * tileSize,
-                    vert.ao,
-                    vert.lightLevel
-                );
-        }
+    // Air only sections do not need any storage
+    if (section->nonAirCount == 0)
+        section.reset();
+}
+
+void Chunk::ChunkData::UnpackRow(int y, int z, BlockType* out) const
+{
+    const ChunkSection* section = sections[y / SECTION_SIZE].get();
+    if (!section)
+    {
+        for (int x = 0; x < WIDTH; x++)
+            out[x] = BlockType::AIR;
+        return;
+    }
+    section->storage.Unpack(ChunkSection::Index(0, y % SECTION_SIZE, z), WIDTH, out);
+}
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
+size_t Chunk::ChunkData::GetMemoryUsage() const
+{
+    size_t bytes = sizeof(ChunkData);
+    for (const auto& section : sections)
+    {
+        if (section)
+            bytes += sizeof(ChunkSection) + section->storage.GetMemoryUsage() - sizeof(BlockStorage);
     }
+    return bytes;
+}
 
-    // Bottom face (-Y)
-    if (renderBottom) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex bottomFace[] = {
-            {-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, lightLevel},
-            { 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, lightLevel},
-            { 0.5f, -0.5f,  0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {-0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+void Chunk::FillPaddedData(const MeshInput& input, PaddedChunkData& padded, int minY, int maxY)
+{
+    BlockType row[WIDTH];
 
-        for (const auto& vert : bottomFace) {
-            vertices.emplace_back(
-                    vert.x + x + chunkPos.x * WIDTH,
-                    vert.y + y,
-                    vert.z + z + chunkPos.y * WIDTH,
-                    (tileX + vert.u) * tileSize,
-                    (tileY + vert.v) * tileSize,
-                    vert.ao,
-                    vert.lightLevel
-                );
+    // Fill Center
+    // Unpack a whole X row at once, this is a lot cheaper than decoding every voxel on its own
+    for (int y = minY; y < maxY; y++) {
+        for (int z = 0; z < WIDTH; z++) {
+            input.center->UnpackRow(y, z, row);
+            for (int x = 0; x < WIDTH; x++)
+                padded.blocks[x + 1][y][z + 1] = row[x];
         }
+    }
+
+    // Neigbor data, missing neighbors are treated as air
+    for (int y = minY; y < maxY; y++) {
+        for (int z = 0; z < WIDTH; z++) {
+            padded.blocks[0][y][z + 1] = input.left ? input.left->Get(WIDTH - 1, y, z) : BlockType::AIR;
+            padded.blocks[WIDTH + 1][y][z + 1] = input.right ? input.right->Get(0, y, z) : BlockType::AIR;
+        }
+
+        if (input.back)
+            input.back->UnpackRow(y, WIDTH - 1, row);
+        for (int x = 0; x < WIDTH; x++)
+            padded.blocks[x + 1][y][0] = input.back ? row[x] : BlockType::AIR;
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
+        if (input.front)
+            input.front->UnpackRow(y, 0, row);
+        for (int x = 0; x < WIDTH; x++)
+            padded.blocks[x + 1][y][WIDTH + 1] = input.front ? row[x] : BlockType::AIR;
     }
+}
+
+/*
+* A section is hidden when it and every section touching one of its faces is completely solid.
+* Then none of its faces can be seen. Outside of the world (above, below, missing chunks) counts as air.
+*/
+bool Chunk::IsSectionHidden(const MeshInput& input, int sectionIndex)
+{
+    auto isSolid = [sectionIndex](const BlockSnapshot& data, int offset) {
+        int index = sectionIndex + offset;
+        if (!data || index < 0 || index >= SECTION_COUNT) return false;
+        const ChunkSection* section = data->GetSection(index);
+        return section && section->IsFullySolid();
+    };
 
-	// TODO: Only apply AO when their is a block below or below + front direction, Check for front, back left, right. But how would this work across chunk boundaries and performance wise.
+    return isSolid(input.center, 0) && isSolid(input.center, 1) && isSolid(input.center, -1) &&
+        isSolid(input.left, 0) && isSolid(input.right, 0) && isSolid(input.back, 0) && isSolid(input.front, 0);
 }
 
-void Chunk::CreateBlockWorker(const PaddedChunkData& data, glm::ivec2 chunkPos, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, int x, int y, int z)
+Chunk::MeshScratch& Chunk::GetThreadScratch()
 {
-    // Air is not a real block so we skip it
-    BlockType blockType = GetBlockTypeFromData(data, x, y, z);
-    if (blockType == BlockType::AIR) return;
+    // Scratch memory per thread, reused for every mesh that thread builds
+    thread_local std::unique_ptr<MeshScratch> scratch = std::make_unique<MeshScratch>();
+    return *scratch;
+}
 
-    bool renderFront = !IsSolid(GetBlockTypeFromData(data, x, y, z + 1));
-    bool renderBack = !IsSolid(GetBlockTypeFromData(data, x, y, z - 1));
-    bool renderLeft = !IsSolid(GetBlockTypeFromData(data, x - 1, y, z));
-    bool renderRight = !IsSolid(GetBlockTypeFromData(data, x + 1, y, z));
-    bool renderTop = !IsSolid(GetBlockTypeFromData(data, x, y + 1, z));
-    bool renderBottom = !IsSolid(GetBlockTypeFromData(data, x, y - 1, z));
+void Chunk::MeshSections(const MeshInput& input, uint32_t sections, MeshScratch& scratch,
+    std::vector<Vertex>& solid, SectionCounts& solidCounts,
+    std::vector<Vertex>& water, SectionCounts& waterCounts,
+    SectionBounds& bounds)
+{
+    solidCounts.fill(0);
+    waterCounts.fill(0);
+    bounds.fill({});
 
-	if (blockType == BlockType::WATER) {
-        // For water, we only render the top face if the block above is not water, and we render the sides if the neighboring block is not solid (to create a "flow" effect)
-        renderTop = !IsSolid(GetBlockTypeFromData(data, x, y + 1, z)) && GetBlockTypeFromData(data, x, y + 1, z) != BlockType::WATER;
-        renderFront = !IsSolid(GetBlockTypeFromData(data, x, y, z + 1)) && GetBlockTypeFromData(data, x, y, z + 1) != BlockType::WATER;
-        renderBack = !IsSolid(GetBlockTypeFromData(data, x, y, z - 1)) && GetBlockTypeFromData(data, x, y, z - 1) != BlockType::WATER;
-        renderLeft = !IsSolid(GetBlockTypeFromData(data, x - 1, y, z)) && GetBlockTypeFromData(data, x - 1, y, z) != BlockType::WATER;
-        renderRight = !IsSolid(GetBlockTypeFromData(data, x + 1, y, z)) && GetBlockTypeFromData(data, x + 1, y, z) != BlockType::WATER;
+    // Empty sections have nothing to mesh and buried sections have no visible faces
+    ColumnMask meshedRange;
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        if ((sections >> section) & 1 && input.center->GetSection(section) && !IsSectionHidden(input, section))
+            meshedRange = meshedRange | ColumnMask::Range(section * SECTION_SIZE, (section + 1) * SECTION_SIZE);
     }
 
-    // Skip if all faces are hdden
-    if (!renderFront && !renderBack && !renderLeft &&
-        !renderRight && !renderTop && !renderBottom) {
+    if (!meshedRange.Any())
         return;
-    }
 
-    float tileSize = 1.0f / 32.0f;
-    int tileX = 0 + blockType - 1;
-    int tileY = 31;
+    // Faces only look one block up and down, so we only need the sections we mesh plus one row around them
+    int minY = std::max(std::countr_zero(sections) * SECTION_SIZE - 1, 0);
+    int maxY = std::min((int)std::bit_width(sections) * SECTION_SIZE + 1, HEIGHT);
 
-    // float lightLevel = GetLightLevelAt(x, y, z, data);
-    float lightLevel = 1;
+    PaddedChunkData& data = scratch.padded;
+    FillPaddedData(input, data, minY, maxY);
+    BuildColumnMasks(data, minY, maxY, scratch.columns);
+    BuildFaceMasks(scratch.columns, meshedRange, scratch.faces);
 
-    // Face data: positions, UV, AO, LightLevel (experimental)
-    struct FaceVertex {
-        float x, y, z, u, v, ao, lightLevel;
-    };
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        ColumnMask range = meshedRange & ColumnMask::Range(section * SECTION_SIZE, (section + 1) * SECTION_SIZE);
+        if (!range.Any())
+            continue;
 
-    // PRECOMPUTE
-    float wx = x + chunkPos.x * WIDTH;
-    float wy = y;
-    float wz = z + chunkPos.y * WIDTH;
-
-    // Front face (+Z)
-    if (renderFront) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex frontFace[] = {
-            {-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, lightLevel},
-            { 0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 1.0f, lightLevel},
-            { 0.5f,  0.5f, 0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {-0.5f,  0.5f, 0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+        size_t solidStart = solid.size();
+        size_t waterStart = water.size();
+
+        EmitFaces(data, scratch.faces.water, range, water);
 
-        for (const auto& vert : frontFace) {
-            vertices.emplace_back(
-                vert.x + x + chunkPos.x * WIDTH,
-                vert.y + y,
-                vert.z + z + chunkPos.y * WIDTH,
-                (tileX + vert.u) * tileSize,
-                (tileY + vert.v) * tileSize,
-                vert.ao,
-                vert.lightLevel
-            );
+        if (input.greedy)
+        {
+            range.ForEachBit([&](int y) {
+                GreedyMeshLayer(data, scratch.faces, solid, y);
+            });
+        }
+        else
+        {
+            EmitFaces(data, scratch.faces.solid, range, solid);
         }
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
+        solidCounts[section] = (uint32_t)(solid.size() - solidStart);
+        waterCounts[section] = (uint32_t)(water.size() - waterStart);
+
+        // Usually far less than the 16 blocks of the section, terrain surfaces are mostly flat
+        for (size_t i = solidStart; i < solid.size(); i++)
+            bounds[section].Add(solid[i].GetY());
+        for (size_t i = waterStart; i < water.size(); i++)
+            bounds[section].Add(water[i].GetY());
     }
+}
 
-    // Back face (-Z)
-    if (renderBack) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex backFace[] = {
-            { 0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, lightLevel},
-            {-0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f, lightLevel},
-            {-0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            { 0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+void Chunk::GenerateMeshWorker(Chunk* chunk, const MeshInput& input, MeshBufferPool& pool)
+{
+    // Only vertices, every mesh is drawn with the shared quad index buffer (see QuadIndexBuffer)
+    // Both come from the pool and go back to it once the chunk uploaded them
+    std::vector<Vertex> localVertices = pool.Acquire();
+    std::vector<Vertex> localWaterVertices = pool.Acquire();
+    size_t solidCapacity = localVertices.capacity();
+    size_t waterCapacity = localWaterVertices.capacity();
 
-        for (const auto& vert : backFace) {
-            vertices.emplace_back(
-                vert.x + x + chunkPos.x * WIDTH,
-                vert.y + y,
-                vert.z + z + chunkPos.y * WIDTH,
-                (tileX + vert.u) * tileSize,
-                (tileY + vert.v) * tileSize,
-                vert.ao,
-                vert.lightLevel
-            );
-        }
+    SectionCounts solidCounts;
+    SectionCounts waterCounts;
+    SectionBounds bounds;
+    MeshSections(input, ALL_SECTIONS, GetThreadScratch(), localVertices, solidCounts, localWaterVertices, waterCounts, bounds);
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
-    }
+    SectionVisibilities visibility;
+    ComputeVisibility(*input.center, ALL_SECTIONS, visibility);
 
-    // Left face (-X)
-    if (renderLeft) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex leftFace[] = {
-            {-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, lightLevel},
-            {-0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 1.0f, lightLevel},
-            {-0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {-0.5f,  0.5f, -0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+    OccluderHeights occluders;
+    ComputeOccluders(*input.center, occluders);
 
-        for (const auto& vert : leftFace) {
-            vertices.emplace_back(
-                vert.x + x + chunkPos.x * WIDTH,
-                vert.y + y,
-                vert.z + z + chunkPos.y * WIDTH,
-                (tileX + vert.u) * tileSize,
-                (tileY + vert.v) * tileSize,
-                vert.ao,
-                vert.lightLevel
-            );
-        }
+    pool.TrackGrowth(solidCapacity, localVertices);
+    pool.TrackGrowth(waterCapacity, localWaterVertices);
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
-    }
+    // Pass data back to the chunk
+    {
+        std::lock_guard<std::mutex> lock(chunk->m_MeshMutex);
 
-    // Right face (+X)
-    if (renderRight) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex rightFace[] = {
-            {0.5f, -0.5f,  0.5f, 0.0f, 0.0f, 1.0f, lightLevel},
-            {0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 1.0f, lightLevel},
-            {0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {0.5f,  0.5f,  0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+        // A mesh that was never uploaded is replaced, its buffers go back to the pool
+        pool.Release(std::move(chunk->m_IntermediateVertices));
+        pool.Release(std::move(chunk->m_IntermediateWaterVertices));
 
-        for (const auto& vert : rightFace) {
-            vertices.emplace_back(
-                vert.x + x + chunkPos.x * WIDTH,
-                vert.y + y,
-                vert.z + z + chunkPos.y * WIDTH,
-                (tileX + vert.u) * tileSize,
-                (tileY + vert.v) * tileSize,
-                vert.ao,
-                vert.lightLevel
-            );
-        }
+        chunk->m_IntermediateVertices = std::move(localVertices);
+        chunk->m_IntermediateWaterVertices = std::move(localWaterVertices);
+        chunk->m_IntermediateCounts = solidCounts;
+        chunk->m_IntermediateWaterCounts = waterCounts;
+        chunk->m_IntermediateBounds = bounds;
+        chunk->m_IntermediateVisibility = visibility;
+        chunk->m_IntermediateOccluders = occluders;
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
+        chunk->m_HasNewMesh = true;
+        chunk->m_IsGenerating = false;
     }
+}
 
-    // Top face (+Y)
-    if (renderTop) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex topFace[] = {
-            {-0.5f, 0.5f,  0.5f, 0.0f, 0.0f, 0.0f, lightLevel},
-            { 0.5f, 0.5f,  0.5f, 1.0f, 0.0f, 0.0f, lightLevel},
-            { 0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {-0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
-
-        for (const auto& vert : topFace) {
-            vertices.emplace_back(
-                vert.x + x + chunkPos.x * WIDTH,
-                vert.y + y,
-                vert.z + z + chunkPos.y * WIDTH,
-                (tileX + vert.u) * tileSize,
-                (tileY + -1 + vert.v) * tileSize,
-                vert.ao,
-                vert.lightLevel
-            );
-        }
+namespace
+{
+    // Extra vertices per section slot with geometry, so edits usually fit without reallocating the buffer
+    constexpr uint32_t SECTION_SLACK_VERTICES = 48;
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
+    uint32_t SumCounts(const Chunk::SectionCounts& counts)
+    {
+        uint32_t sum = 0;
+        for (uint32_t count : counts)
+            sum += count;
+        return sum;
     }
+}
 
-    // Bottom face (-Y)
-    if (renderBottom) {
-        unsigned int baseIndex = static_cast<unsigned int>(vertices.size());
-        FaceVertex bottomFace[] = {
-            {-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, lightLevel},
-            { 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, lightLevel},
-            { 0.5f, -0.5f,  0.5f, 1.0f, 1.0f, 0.0f, lightLevel},
-            {-0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 0.0f, lightLevel}
-        };
+void Chunk::UploadLayer(const std::vector<Vertex>& vertices, const SectionCounts& counts, ChunkMeshArena& arena, MeshLayout& layout)
+{
+    arena.Free({ layout.base, layout.size });
+    layout = {};
 
-        for (const auto& vert : bottomFace) {
-            vertices.emplace_back(
-                vert.x + x + chunkPos.x * WIDTH,
-                vert.y + y,
-                vert.z + z + chunkPos.y * WIDTH,
-                (tileX + vert.u) * tileSize,
-                (tileY + vert.v) * tileSize,
-                vert.ao,
-                vert.lightLevel
-            );
-        }
+    if (vertices.empty())
+        return;
 
-        indices.push_back(baseIndex + 0);
-        indices.push_back(baseIndex + 1);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 2);
-        indices.push_back(baseIndex + 3);
-        indices.push_back(baseIndex + 0);
+    // Only used on the main thread, kept around so uploads don't allocate
+    static std::vector<Vertex> staging;
+    staging.clear();
+
+    uint32_t source = 0;
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        uint32_t count = counts[section];
+
+        // Whole quads only, the padding has to stay aligned to 4 vertices.
+        // Empty sections (mostly air above the terrain) get no slot, the first edit there does a full upload instead.
+        uint32_t capacity = count == 0 ? 0 : (count + count / 8 + SECTION_SLACK_VERTICES + 3) & ~3u;
+
+        layout.offset[section] = (uint32_t)staging.size();
+        layout.capacity[section] = capacity;
+        layout.count[section] = count;
+
+        staging.insert(staging.end(), vertices.begin() + source, vertices.begin() + source + count);
+        staging.resize(staging.size() + capacity - count);
+        source += count;
     }
+    layout.size = (uint32_t)staging.size();
 
-    // TODO: Only apply AO when their is a block below or below + front direction, Check for front, back left, right. But how would this work across chunk boundaries and performance wise.
+    ChunkMeshArena::Allocation allocation = arena.Allocate(layout.size);
+    layout.base = allocation.offset;
+    arena.Upload(layout.base, staging.data(), layout.size);
 }
 
-void Chunk::GenerateMeshWorker(Chunk* chunk, const PaddedChunkData data, glm::ivec2 position)
+bool Chunk::FitsLayout(const SectionCounts& counts, uint32_t sections, const MeshLayout& layout)
 {
-    std::vector<Vertex> localVertices;
-    std::vector<unsigned int> localIndices;
-    
-    std::vector<Vertex> localWaterVertices;
-    std::vector<unsigned int> localWaterIndices;
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        if ((sections >> section) & 1 && counts[section] > layout.capacity[section])
+            return false;
+    }
+    return true;
+}
 
-    localWaterVertices.reserve(2048);
-    localWaterIndices.reserve(3072);
+void Chunk::PatchLayer(const std::vector<Vertex>& vertices, const SectionCounts& counts, uint32_t sections, ChunkMeshArena& arena, MeshLayout& layout)
+{
+    // Overwrites what is left of the old vertices of a slot
+    static std::vector<Vertex> zeros;
 
-    // Use a conservative reserve to avoid reallocations
-    localVertices.reserve(8192);
-    localIndices.reserve(12288);
+    uint32_t source = 0;
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        if (!((sections >> section) & 1))
+            continue;
 
-    for (int x = 0; x < WIDTH; x++)
-        for (int y = 0; y < HEIGHT; y++)
-            for (int z = 0; z < WIDTH; z++)
-            {
-				BlockType type = GetBlockTypeFromData(data, x, y, z);
-                if (type == BlockType::AIR) continue;
+        uint32_t count = counts[section];
+        uint32_t oldCount = layout.count[section];
 
-                if (type == BlockType::WATER)
-                {
-					CreateBlockWorker(data, position, localWaterVertices, localWaterIndices, x, y, z);
-                }
-                else
-                {
-                    CreateBlockWorker(data, position, localVertices, localIndices, x, y, z);
-                }
-            }
+        uint32_t offset = layout.base + layout.offset[section];
+        arena.Upload(offset, vertices.data() + source, count);
 
-    // Pass data back to the chunk
+        if (oldCount > count)
+        {
+            if (zeros.size() < oldCount - count)
+                zeros.resize(oldCount - count);
+            arena.Upload(offset + count, zeros.data(), oldCount - count);
+        }
+
+        layout.count[section] = count;
+        source += count;
+    }
+}
+
+Chunk::MeshInput Chunk::BuildMeshInput(World* world) const
+{
+    glm::ivec2 pos = m_ChunkPosition;
+
+    // Neighbors are looked up on the main thread, the job only gets their snapshots.
+    // No blocks are copied here, SetBlock copies on write if a job still holds a snapshot.
+    auto snapshotOf = [world](int cx, int cz) -> BlockSnapshot {
+        Chunk* neighbor = world->GetChunk(cx, cz);
+        if (neighbor && neighbor->IsTerrainGenerated())
+            return neighbor->GetBlockSnapshot();
+        return nullptr;
+    };
+
+    MeshInput input;
+    input.greedy = world->greedyMeshing;
+    input.center = m_Blocks;
+    input.left = snapshotOf(pos.x - 1, pos.y);
+    input.right = snapshotOf(pos.x + 1, pos.y);
+    input.back = snapshotOf(pos.x, pos.y - 1);
+    input.front = snapshotOf(pos.x, pos.y + 1);
+    return input;
+}
+
+bool Chunk::RemeshSections(World* world, uint32_t sections)
+{
+    MeshInput input = BuildMeshInput(world);
+    MeshBufferPool& pool = world->GetMeshBufferPool();
+
+    std::vector<Vertex> solid = pool.Acquire();
+    std::vector<Vertex> water = pool.Acquire();
+    SectionCounts solidCounts;
+    SectionCounts waterCounts;
+    SectionBounds bounds;
+    MeshSections(input, sections, GetThreadScratch(), solid, solidCounts, water, waterCounts, bounds);
+
+    // Either both layers are patched or none, a section that outgrew its slot needs new buffers
+    bool fits = FitsLayout(solidCounts, sections, m_SolidLayout) && FitsLayout(waterCounts, sections, m_WaterLayout);
+    if (fits)
     {
-        std::lock_guard<std::mutex> lock(chunk->m_MeshMutex);
-        chunk->m_IntermediateVertices = std::move(localVertices);
-        chunk->m_IntermediateIndices = std::move(localIndices);
+        PatchLayer(solid, solidCounts, sections, world->GetMeshArena(), m_SolidLayout);
+        PatchLayer(water, waterCounts, sections, world->GetMeshArena(), m_WaterLayout);
 
-        chunk->m_IntermediateWaterVertices = std::move(localWaterVertices);
-        chunk->m_IntermediateWaterIndices = std::move(localWaterIndices);
-        chunk->m_HasNewWaterMesh = true;
+        m_SolidVertexCount = SumCounts(m_SolidLayout.count);
+        m_WaterVertexCount = SumCounts(m_WaterLayout.count);
+        SetSectionBounds(bounds, sections);
 
-        chunk->m_HasNewMesh = true;
-        chunk->m_IsGenerating = false;
+        SectionVisibilities visibility;
+        ComputeVisibility(*input.center, sections, visibility);
+        SetSectionVisibility(visibility, sections);
+
+        // Cheap enough to redo for the whole chunk, an edit anywhere below can lower a column
+        ComputeOccluders(*input.center, m_Occluders);
     }
+
+    pool.Release(std::move(solid));
+    pool.Release(std::move(water));
+    return fits;
+}
+
+size_t Chunk::UploadNewMesh(World* world)
+{
+    if (!m_HasNewMesh)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(m_MeshMutex);
+
+    UploadLayer(m_IntermediateVertices, m_IntermediateCounts, world->GetMeshArena(), m_SolidLayout);
+    UploadLayer(m_IntermediateWaterVertices, m_IntermediateWaterCounts, world->GetMeshArena(), m_WaterLayout);
+
+    m_SolidVertexCount = m_IntermediateVertices.size();
+    m_WaterVertexCount = m_IntermediateWaterVertices.size();
+    SetSectionBounds(m_IntermediateBounds, ALL_SECTIONS);
+    SetSectionVisibility(m_IntermediateVisibility, ALL_SECTIONS);
+    m_Occluders = m_IntermediateOccluders;
+    m_HasMeshLayout = true;
+    m_State = ChunkState::MESHED;
+
+    world->GetMeshBufferPool().Release(std::move(m_IntermediateVertices));
+    world->GetMeshBufferPool().Release(std::move(m_IntermediateWaterVertices));
+    m_IntermediateVertices = {};
+    m_IntermediateWaterVertices = {};
+    m_HasNewMesh = false;
+
+    return (size_t)(m_SolidLayout.size + m_WaterLayout.size) * sizeof(Vertex);
 }
 
 void Chunk::Update(World* world)
 {
-    // If we have a new mesh ready from the thread, upload it
+    // Read before m_HasNewMesh, the worker sets that first and then clears this.
+    // The other way around a job finishing in between looks like no job and no new mesh.
+    bool generating = m_IsGenerating;
+
+    // A mesh waiting for its upload goes first, edits are patched on top of it afterwards.
+    // Patching the old mesh now would be lost once the new one (from an older snapshot) replaces it.
     if (m_HasNewMesh)
+        return;
+
+    // Block edits only remesh the sections they touched, right here so they show up this frame.
+    // While a full mesh job runs we wait for it, its snapshot might be older than the edit.
+    uint32_t dirtySections = m_DirtySections;
+    if (dirtySections && m_HasMeshLayout && !m_IsDirty && !generating)
     {
-        std::lock_guard<std::mutex> lock(m_MeshMutex);
+        m_DirtySections &= ~dirtySections;
+        if (!RemeshSections(world, dirtySections))
+            m_IsDirty = true;
+    }
 
-        delete m_VA; delete m_VB; delete m_IB;
-        m_VA = nullptr; m_VB = nullptr; m_IB = nullptr;
+    if (m_IsDirty && !generating && m_State >= ChunkState::READY)
+    {
+        m_IsGenerating = true;
+        m_IsDirty = false;
+        m_MeshJobCount++;
 
-        if (!m_IntermediateVertices.empty() && !m_IntermediateIndices.empty())
-        {
-            m_VA = new VertexArray();
-            m_VA->Bind();
+        // The snapshot has every edit so far, no need to patch sections on top
+        m_DirtySections = 0;
 
-            m_VB = new VertexBuffer(m_IntermediateVertices.data(), m_IntermediateVertices.size() * sizeof(Vertex));
+        MeshInput input = BuildMeshInput(world);
+        input.jobEpoch = GetJobEpoch();
 
-            VertexBufferLayout layout;
-            layout.Push<float>(3); // X, Y, Z
-            layout.Push<float>(2); // U, V
-            layout.Push<float>(1); // Ambient Occlusion
-			layout.Push<float>(1); // Light Level (experimental)
+        // The job keeps the chunk alive, it might get unloaded while the job is queued
+        auto job = [self = shared_from_this(), input = std::move(input), world]() {
+            // Left the window while queued, the mesh would never be drawn. Meshed again if it comes back.
+            if (!self->IsJobCurrent(input.jobEpoch))
+            {
+                self->m_IsDirty = true;
+                self->m_IsGenerating = false;
+                world->CountCancelledJob(false);
+                world->RequestChunkUpdate(self->GetChunkPosition());
+                return;
+            }
 
-            m_VA->AddBuffer(*m_VB, layout);
-            m_IB = new IndexBuffer(m_IntermediateIndices.data(), m_IntermediateIndices.size());
+            // Generate mesh using the snapshot
+            GenerateMeshWorker(self.get(), input, world->GetMeshBufferPool());
 
-            m_VA->Unbind();
-        }
+            // The upload happens in our next Update
+            world->RequestChunkUpdate(self->GetChunkPosition());
+        };
 
-        m_IntermediateVertices.clear();
-        m_IntermediateIndices.clear();
-        m_HasNewMesh = false;
+        // Anything bigger would allocate on every mesh job
+        static_assert(sizeof(job) <= Job::INLINE_SIZE, "Mesh job no longer fits into Job's inline storage");
+        world->EnqueueJob(std::move(job));
     }
+}
+
+
+void Chunk::ReleaseGPUResources(ChunkMeshArena& arena)
+{
+    arena.Free({ m_SolidLayout.base, m_SolidLayout.size });
+    arena.Free({ m_WaterLayout.base, m_WaterLayout.size });
+
+    m_SolidLayout = {};
+    m_WaterLayout = {};
+    m_HasMeshLayout = false;
+    m_SolidVertexCount = 0;
+    m_WaterVertexCount = 0;
+    SetSectionBounds({}, ALL_SECTIONS);
+    m_Occluders = {};
+}
 
-    if (m_HasNewWaterMesh)
+void Chunk::SetSectionBounds(const SectionBounds& bounds, uint32_t sections)
+{
+    m_Bounds = {};
+    m_MeshSections = 0;
+    for (int section = 0; section < SECTION_COUNT; section++)
     {
-        std::lock_guard<std::mutex> lock(m_MeshMutex);
-
-        // Upload water mesh
-        delete m_WaterVA; delete m_WaterVB; delete m_WaterIB;
-        m_WaterVA = nullptr; m_WaterVB = nullptr; m_WaterIB = nullptr;
-
-        if (!m_IntermediateWaterVertices.empty()) {
-            m_WaterVA = new VertexArray();
-            m_WaterVA->Bind();
-            m_WaterVB = new VertexBuffer(m_IntermediateWaterVertices.data(),
-                m_IntermediateWaterVertices.size() * sizeof(Vertex));
-            VertexBufferLayout layout;
-            layout.Push<float>(3);
-            layout.Push<float>(2);
-            layout.Push<float>(1);
-            layout.Push<float>(1);
-            m_WaterVA->AddBuffer(*m_WaterVB, layout);
-            m_WaterIB = new IndexBuffer(m_IntermediateWaterIndices.data(),
-                m_IntermediateWaterIndices.size());
-            m_WaterVA->Unbind();
+        if ((sections >> section) & 1)
+            m_SectionBounds[section] = bounds[section];
+        m_Bounds.Add(m_SectionBounds[section]);
+
+        if (!m_SectionBounds[section].IsEmpty())
+            m_MeshSections |= 1u << section;
+    }
+}
+
+void Chunk::ComputeVisibility(const ChunkData& data, uint32_t sections, SectionVisibilities& visibility)
+{
+    for (int index = 0; index < SECTION_COUNT; index++)
+    {
+        if (!((sections >> index) & 1))
+            continue;
+
+        // Most sections are all air or all stone, no need to flood fill those
+        const ChunkSection* section = data.GetSection(index);
+        if (!section)
+        {
+            visibility[index] = SectionVisibility::Open();
+            continue;
+        }
+        if (section->IsFullySolid())
+        {
+            visibility[index] = SectionVisibility::Closed();
+            continue;
+        }
+        if (section->IsUniform())
+        {
+            visibility[index] = SectionVisibility::Open(); // Water or leaves
+            continue;
         }
 
-        m_IntermediateWaterVertices.clear();
-        m_IntermediateWaterIndices.clear();
-        m_HasNewWaterMesh = false;
+        BlockType blocks[SECTION_VOLUME];
+        uint8_t opaque[SECTION_VOLUME];
+        section->storage.Unpack(0, SECTION_VOLUME, blocks);
+        for (int i = 0; i < SECTION_VOLUME; i++)
+            opaque[i] = IsSolid(blocks[i]);
+
+        visibility[index] = SectionVisibility::Compute(opaque);
     }
+}
 
-    if (m_IsDirty && !m_IsGenerating)
+void Chunk::SetSectionVisibility(const SectionVisibilities& visibility, uint32_t sections)
+{
+    for (int section = 0; section < SECTION_COUNT; section++)
     {
-        m_IsGenerating = true;
-        m_IsDirty = false;
+        if ((sections >> section) & 1)
+            m_SectionVisibility[section] = visibility[section];
+    }
+}
 
-        glm::ivec2 pos = m_ChunkPosition;
-        
-        // Prepare Padded Data on Main Thread to avoid race conditions with SetBlock
-        // Access neighbors safely on Main Thread
-        Chunk* leftN = world->GetChunk(pos.x - 1, pos.y);
-        Chunk* rightN = world->GetChunk(pos.x + 1, pos.y);
-        Chunk* backN = world->GetChunk(pos.x, pos.y - 1);
-        Chunk* frontN = world->GetChunk(pos.x, pos.y + 1);
-
-        // Copy data
-        // We create a shared_ptr to the padded data so we can move it into the lambda
-        // Using shared_ptr avoids large stack copies if the lambda captures by value
-        auto paddedData = std::make_shared<PaddedChunkData>();
-
-        // Fill Center
-        for (int x = 0; x < WIDTH; x++) {
-            for (int y = 0; y < HEIGHT; y++) {
-                for (int z = 0; z < WIDTH; z++) {
-                    paddedData->blocks[x + 1][y][z + 1] = m_Blocks.blocks[x][y][z];
+void Chunk::ComputeOccluders(const ChunkData& data, OccluderHeights& heights)
+{
+    // Height of the solid run from the bottom of every column, HEIGHT until we find its end
+    uint8_t columns[WIDTH * WIDTH];
+    std::fill(std::begin(columns), std::end(columns), (uint8_t)HEIGHT);
+    int open = WIDTH * WIDTH;
+
+    for (int index = 0; index < SECTION_COUNT && open > 0; index++)
+    {
+        const ChunkSection* section = data.GetSection(index);
+        if (section && section->IsFullySolid())
+            continue;
+
+        for (int ly = 0; ly < SECTION_SIZE && open > 0; ly++)
+        {
+            int y = index * SECTION_SIZE + ly;
+
+            // One horizontal layer, indexed z * WIDTH + x like the columns
+            BlockType layer[WIDTH * WIDTH];
+            if (section)
+                section->storage.Unpack(ChunkSection::Index(0, ly, 0), WIDTH * WIDTH, layer);
+            else
+                std::fill(std::begin(layer), std::end(layer), BlockType::AIR);
+
+            for (int column = 0; column < WIDTH * WIDTH; column++)
+            {
+                if (columns[column] == HEIGHT && !IsSolid(layer[column]))
+                {
+                    columns[column] = (uint8_t)y;
+                    open--;
                 }
             }
         }
+    }
 
-        // Neigbor data
-        if (leftN && leftN->IsTerrainGenerated()) {
-            for (int y = 0; y < HEIGHT; y++)
-                for (int z = 0; z < WIDTH; z++)
-                    paddedData->blocks[0][y][z + 1] = leftN->m_Blocks.blocks[WIDTH - 1][y][z];
+    for (int qz = 0; qz < 2; qz++)
+    {
+        for (int qx = 0; qx < 2; qx++)
+        {
+            uint8_t height = HEIGHT;
+            for (int z = qz * QUADRANT_SIZE; z < (qz + 1) * QUADRANT_SIZE; z++)
+            {
+                for (int x = qx * QUADRANT_SIZE; x < (qx + 1) * QUADRANT_SIZE; x++)
+                    height = std::min(height, columns[z * WIDTH + x]);
+            }
+            heights[qz * 2 + qx] = height;
         }
+    }
+}
 
-        if (rightN && rightN->IsTerrainGenerated()) {
-            for (int y = 0; y < HEIGHT; y++)
-                for (int z = 0; z < WIDTH; z++)
-                    paddedData->blocks[WIDTH + 1][y][z + 1] = rightN->m_Blocks.blocks[0][y][z];
+bool Chunk::GetMeshBounds(glm::vec3& boxMin, glm::vec3& boxMax, uint32_t sections) const
+{
+    HeightRange bounds = m_Bounds;
+    if (sections != ALL_SECTIONS)
+    {
+        bounds = {};
+        for (int section = 0; section < SECTION_COUNT; section++)
+        {
+            if ((sections >> section) & 1)
+                bounds.Add(m_SectionBounds[section]);
         }
+    }
 
-        if (backN && backN->IsTerrainGenerated()) {
-            for (int x = 0; x < WIDTH; x++)
-                for (int y = 0; y < HEIGHT; y++)
-                    paddedData->blocks[x + 1][y][0] = backN->m_Blocks.blocks[x][y][WIDTH - 1];
-        }
+    if (bounds.IsEmpty())
+        return false;
 
-        if (frontN && frontN->IsTerrainGenerated()) {
-            for (int x = 0; x < WIDTH; x++)
-                for (int y = 0; y < HEIGHT; y++)
-                    paddedData->blocks[x + 1][y][WIDTH + 1] = frontN->m_Blocks.blocks[x][y][0];
-        }
+    // Vertices are block corners, the shader moves them by -0.5 like the blocks themselves.
+    // A little extra height for the water waves, see water_vertex.shader
+    constexpr float WAVE_HEIGHT = 0.1f;
 
-        world->EnqueueJob([this, paddedData, pos]() {
-            // Generate mesh using the snapshot
-            GenerateMeshWorker(this, *paddedData, pos);
-        });
-    }
+    glm::vec3 origin((float)(m_ChunkPosition.x * WIDTH), 0.0f, (float)(m_ChunkPosition.y * WIDTH));
+    boxMin = origin + glm::vec3(-0.5f, bounds.min - 0.5f - WAVE_HEIGHT, -0.5f);
+    boxMax = origin + glm::vec3(WIDTH - 0.5f, bounds.max - 0.5f + WAVE_HEIGHT, WIDTH - 0.5f);
+    return true;
 }
 
+size_t Chunk::GetMemoryUsage() const
+{
+    size_t gpuBytes = (size_t)(m_SolidLayout.size + m_WaterLayout.size) * sizeof(Vertex);
+    return sizeof(Chunk) + GetBlockMemoryUsage() + gpuBytes;
+}
 
-void Chunk::Render(Renderer& renderer, Shader& shader, int layer)
+void Chunk::AppendDrawCommand(int layer, std::vector<ChunkMeshArena::DrawCommand>& commands, uint32_t sections) const
 {
-	if (layer == 0) {
-        if (!m_VA || !m_IB) return;
-        if (m_IB->GetCount() == 0) return;
-        renderer.Draw(*m_VA, *m_IB, shader);
-    } else if (layer == 2) {
-        if (!m_WaterVA || !m_WaterIB) return;
-        if (m_WaterIB->GetCount() == 0) return;
-        renderer.Draw(*m_WaterVA, *m_WaterIB, shader);
+    const MeshLayout* layout = layer == 0 ? &m_SolidLayout : layer == 2 ? &m_WaterLayout : nullptr;
+    if (!layout || layout->size == 0)
+        return;
+
+    // Vertices are chunk local, the origin moves them into place
+    glm::vec3 origin((float)(m_ChunkPosition.x * WIDTH), 0.0f, (float)(m_ChunkPosition.y * WIDTH));
+
+    // Slots are back to back, a run of sections is one range. The unused rest of the slots in between are degenerate quads.
+    int section = 0;
+    while (section < SECTION_COUNT)
+    {
+        if (!((sections >> section) & 1))
+        {
+            section++;
+            continue;
+        }
+
+        int first = section;
+        uint32_t vertices = 0;
+        while (section < SECTION_COUNT && (sections >> section) & 1)
+            vertices += layout->count[section++];
+
+        if (vertices == 0)
+            continue;
+
+        int last = section - 1;
+        uint32_t begin = layout->offset[first];
+        uint32_t end = layout->offset[last] + layout->count[last];
+        commands.push_back({ layout->base + begin, end - begin, origin });
     }
 }
 
 BlockType Chunk::GetBlockType(int x, int y, int z)
 {
-    return m_Blocks.blocks[x][y][z].GetType();
+    // Raycasts can leave the world vertically, everything above and below the chunk is air
+    if (y < 0 || y >= HEIGHT)
+        return BlockType::AIR;
+    return m_Blocks->Get(x, y, z);
 }
 
 void Chunk::SetBlock(int x, int y, int z, BlockType type)
 {
     if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT && z >= 0 && z < WIDTH)
     {
-        m_Blocks.blocks[x][y][z] = Block(type);
-        m_IsDirty = true;
+        // A mesh job still reads the current blocks, give it its own copy and write into a fresh one
+        if (m_Blocks.use_count() > 1)
+            m_Blocks = std::make_shared<ChunkData>(*m_Blocks);
+
+        m_Blocks->Set(x, y, z, type);
+        m_Blocks->version++;
+
+        // Only the section of the block needs a new mesh, plus the one above or below if the block is on its border
+        int section = y / SECTION_SIZE;
+        uint32_t dirty = 1u << section;
+        if (y % SECTION_SIZE == 0 && section > 0)
+            dirty |= 1u << (section - 1);
+        if (y % SECTION_SIZE == SECTION_SIZE - 1 && section < SECTION_COUNT - 1)
+            dirty |= 1u << (section + 1);
+        m_DirtySections |= dirty;
+    }
+}
+
+void Chunk::CompactBlocks()
+{
+    if (m_Blocks.use_count() > 1)
+        m_Blocks = std::make_shared<ChunkData>(*m_Blocks);
+
+    for (auto& section : m_Blocks->sections)
+    {
+        if (!section) continue;
+        if (section.use_count() > 1)
+            section = std::make_shared<ChunkSection>(*section);
+        section->storage.Compact();
     }
 }
 
@@ -1,23 +1,42 @@
 #pragma once
 #include <glm.hpp>
 #include <vector>
+#include <memory>
 #include <mutex>
 #include <atomic>
 #include "../Shader.h"
 #include "Block.h"
+#include "BlockStorage.h"
+#include "ColumnMask.h"
+#include "ChunkMeshArena.h"
+#include "SectionVisibility.h"
 #include <array>
+#include <algorithm>
 #include "../VertexArray.h"
 #include "../VertexBuffer.h"
 #include "../IndexBuffer.h"
 #include "../Renderer.h"
 
 class World;
+class MeshBufferPool;
 
+/*
+* Packed chunk vertex, 8 bytes. Decoded in vertex.shader and water_vertex.shader.
+* data0: x 5 | y 8 | z 5 | ao 2 | light 4	Block corner relative to the chunk origin (a_ChunkOrigin attribute)
+* data1: tile 10 | u 5 | v 5				Atlas tile (tileY * 32 + tileX), UV in blocks so merged quads tile
+*/
 struct Vertex {
-	float x, y, z;
-	float u, v;
-	float ao;
-	float light;
+	uint32_t data0;
+	uint32_t data1;
+
+	// Zero vertex, 4 of them are a degenerate quad that draws nothing. Used to pad the section slots of a mesh
+	Vertex() : data0(0), data1(0) { }
+
+	Vertex(uint32_t x, uint32_t y, uint32_t z, uint32_t ao, uint32_t light, uint32_t tile, uint32_t u, uint32_t v)
+		: data0(x | y << 5 | z << 13 | ao << 18 | light << 20),
+		  data1(tile | u << 10 | v << 15) { }
+
+	uint32_t GetY() const { return (data0 >> 5) & 0xFF; }
 };
 
 enum class RenderLayer {
@@ -26,17 +45,142 @@ enum class RenderLayer {
 	TRANSLUCENT = 2
 };
 
-class Chunk
+/*
+* Load pipeline of a chunk, it only moves forward.
+* A chunk is meshed once all 4 neighbors are DECORATED, the mesher needs their border blocks. Before, every new neighbor meant another full remesh.
+* There is no light stage, vertex light is constant for now.
+*/
+enum class ChunkState : uint8_t {
+	TERRAIN = 0,	// Terrain job queued or running, blocks belong to the job
+	DECORATED = 1,	// Terrain and trees done, waiting for the neighbors
+	READY = 2,		// Neighbors are there, first mesh queued
+	MESHED = 3		// Has a mesh, edits remesh from here
+};
+
+class Chunk : public std::enable_shared_from_this<Chunk>
 {
 public:
 	static constexpr int WIDTH = 16;
 	static constexpr int HEIGHT = 128;
 
+	enum Face {
+		FACE_FRONT = 0,	// +Z
+		FACE_BACK = 1,	// -Z
+		FACE_LEFT = 2,	// -X
+		FACE_RIGHT = 3,	// +X
+		FACE_TOP = 4,	// +Y
+		FACE_BOTTOM = 5,// -Y
+		FACE_COUNT = 6
+	};
+
+	// Chunks are split vertically into 16x16x16 sections
+	static constexpr int SECTION_SIZE = 16;
+	static constexpr int SECTION_COUNT = HEIGHT / SECTION_SIZE;
+	static constexpr int SECTION_VOLUME = WIDTH * SECTION_SIZE * WIDTH;
+	static constexpr uint32_t ALL_SECTIONS = (1u << SECTION_COUNT) - 1;
+
+	// Palette compressed, see BlockStorage. Indexed Y-major so horizontal layers are contiguous.
+	struct ChunkSection {
+		BlockStorage storage{ SECTION_VOLUME };
+		int nonAirCount = 0;
+		int solidCount = 0;
+
+		static int Index(int x, int ly, int z) { return (ly * WIDTH + z) * WIDTH + x; }
+
+		bool IsUniform() const { return storage.IsUniform(); }
+		bool IsFullySolid() const { return solidCount == SECTION_VOLUME; }
+
+		BlockType Get(int x, int ly, int z) const { return storage.Get(Index(x, ly, z)); }
+		void Set(int x, int ly, int z, BlockType type);
+	};
+
+	/*
+	* Sections that only contain air are not allocated at all (nullptr).
+	* Sections are shared between snapshots and only copied when written to, so copying a ChunkData only copies 8 pointers.
+	*/
 	struct ChunkData {
-		Block blocks[WIDTH][HEIGHT][WIDTH];
+		std::array<std::shared_ptr<ChunkSection>, SECTION_COUNT> sections;
+		uint32_t version = 0; // Bumped on every SetBlock so snapshots can be told apart
+
+		const ChunkSection* GetSection(int index) const { return sections[index].get(); }
+
+		BlockType Get(int x, int y, int z) const
+		{
+			const ChunkSection* section = sections[y / SECTION_SIZE].get();
+			return section ? section->Get(x, y % SECTION_SIZE, z) : BlockType::AIR;
+		}
+
+		void Set(int x, int y, int z, BlockType type);
+
+		// Unpacks the WIDTH blocks of the X row at (y, z)
+		void UnpackRow(int y, int z, BlockType* out) const;
+
+		size_t GetMemoryUsage() const;
+	};
+
+	/*
+	* Read only view of a chunks blocks. Mesh jobs hold on to these instead of copying the blocks.
+	* SetBlock only writes in place while nobody else holds the snapshot, otherwise it copies first (copy-on-write).
+	*/
+	using BlockSnapshot = std::shared_ptr<const ChunkData>;
+
+	// Everything a mesh job needs: our blocks plus the 4 direct neighbors (nullptr if not generated yet)
+	struct MeshInput {
+		BlockSnapshot center;
+		BlockSnapshot left;		// -X
+		BlockSnapshot right;	// +X
+		BlockSnapshot back;		// -Z
+		BlockSnapshot front;	// +Z
+
+		bool greedy = false;	// Merge solid faces, see GreedyMeshLayer
+		uint32_t jobEpoch = 0;	// GetJobEpoch when a mesh job was queued, sits in the padding after greedy
+	};
+
+	// Vertices per section of a mesh, the mesher writes the sections one after another
+	using SectionCounts = std::array<uint32_t, SECTION_COUNT>;
+
+	// Lowest and highest vertex Y the mesher emitted, chunk local block corners like in Vertex. Empty if min > max.
+	struct HeightRange {
+		uint8_t min = 255;
+		uint8_t max = 0;
+
+		bool IsEmpty() const { return min > max; }
+		void Add(uint32_t y) { min = std::min(min, (uint8_t)y); max = std::max(max, (uint8_t)y); }
+		void Add(const HeightRange& other) { min = std::min(min, other.min); max = std::max(max, other.max); }
+	};
+
+	// Solid and water geometry of each section together
+	using SectionBounds = std::array<HeightRange, SECTION_COUNT>;
+
+	using SectionVisibilities = std::array<SectionVisibility, SECTION_COUNT>;
+
+	// How many blocks every column of a quadrant (8x8 columns) is solid from the bottom up, indexed qz * 2 + qx.
+	// Boxes that high are completely opaque, OcclusionBuffer draws them as occluders.
+	static constexpr int QUADRANT_SIZE = WIDTH / 2;
+	using OccluderHeights = std::array<uint8_t, 4>;
+
+	// Per frame state of SectionOcclusion, main thread only
+	struct OcclusionState {
+		uint32_t pass = 0;		// Walk the rest belongs to, older values are stale
+		uint8_t reached = 0;	// Sections the walk got to
+		uint8_t inFrustum = 0;	// Sections whose box is at least partially in the frustum
+	};
+
+	/*
+	* Where each section's vertices are in a layer's vertex buffer.
+	* Every section gets a slot with some slack, so an edit only remeshes its section and overwrites that slot (see RemeshSections).
+	* Unused vertices of a slot are zero, they form degenerate quads.
+	*/
+	struct MeshLayout {
+		std::array<uint32_t, SECTION_COUNT> offset{};
+		std::array<uint32_t, SECTION_COUNT> capacity{};
+		SectionCounts count{};
+		uint32_t size = 0; // All slots, what we draw
+		uint32_t base = 0; // First vertex in the ChunkMeshArena, offsets are relative to it
 	};
 
-	// To know if neighboring blocks are solid, we create a padded version of ChunkData so we avoid rendering these faces unnecessarily.
+	// To know if neighboring blocks are solid, the mesh worker unpacks the snapshots into a padded block array so we avoid rendering these faces unnecessarily.
+	// One per thread that builds meshes, see GetThreadScratch.
 	struct PaddedChunkData {
 		Block blocks[WIDTH + 2][HEIGHT][WIDTH + 2]; // +2 So we have a 1 block padding on each side in X and Z
 	};
@@ -48,18 +192,18 @@ private:
 	*/
 	glm::ivec2 m_ChunkPosition;
 
-	// For Solid Meshes
-	VertexArray* m_VA;
-	VertexBuffer* m_VB;
-	IndexBuffer* m_IB;
+	// Where the solid and water meshes live in the worlds ChunkMeshArena
+	MeshLayout m_SolidLayout;
+	MeshLayout m_WaterLayout;
 
-	// For Water Meshes
-	VertexArray* m_WaterVA;
-	VertexBuffer* m_WaterVB;
-	IndexBuffer* m_WaterIB;
+	// Set once the first full mesh is uploaded, from then on edits can patch single sections
+	bool m_HasMeshLayout = false;
 
-	ChunkData m_Blocks;
-	PaddedChunkData m_PaddedBlocks;
+	// Sections changed by SetBlock since the last mesh, one bit per section
+	std::atomic<uint32_t> m_DirtySections{ 0 };
+
+	// Only ever replaced on the thread that writes blocks, see SetBlock
+	std::shared_ptr<ChunkData> m_Blocks;
 
 	bool m_HasSelectedBlock;
 	glm::ivec3 m_SelectedBlock;
@@ -69,49 +213,143 @@ private:
 	std::atomic<bool> m_HasNewMesh{ false };
 	std::atomic<bool> m_IsDirty{ false };
 	std::atomic<bool> m_IsGenerating{ false };
-	bool m_IsTerrainGenerated{ false };
+	std::atomic<ChunkState> m_State{ ChunkState::TERRAIN };
 
-	std::vector<Vertex> m_IntermediateVertices;
-	std::vector<unsigned int> m_IntermediateIndices;
+	// Full mesh jobs started for this chunk, ideally 1 unless blocks or settings change
+	uint32_t m_MeshJobCount = 0;
+
+	// Bumped when the chunk leaves the window or gets unloaded. Jobs remember it when queued and drop their work if it changed.
+	std::atomic<uint32_t> m_JobEpoch{ 0 };
 
+	std::vector<Vertex> m_IntermediateVertices;
 	std::vector<Vertex> m_IntermediateWaterVertices;
-	std::vector<unsigned int> m_IntermediateWaterIndices;
-	bool m_HasNewWaterMesh = false;
+	SectionCounts m_IntermediateCounts{};
+	SectionCounts m_IntermediateWaterCounts{};
+	SectionBounds m_IntermediateBounds{};
+
+	// Of the uploaded mesh, m_Bounds is all sections together. Culling uses these instead of the full chunk height.
+	SectionBounds m_SectionBounds{};
+	HeightRange m_Bounds;
+	uint32_t m_MeshSections = 0; // Sections with geometry, one bit per section
+
+	// Which faces of each section see each other, from the same blocks as the mesh
+	SectionVisibilities m_IntermediateVisibility{};
+	SectionVisibilities m_SectionVisibility{};
+
+	OccluderHeights m_IntermediateOccluders{};
+	OccluderHeights m_Occluders{};
+
+	OcclusionState m_OcclusionState;
+
+	// Vertices of the currently uploaded meshes, 4 per quad
+	size_t m_SolidVertexCount = 0;
+	size_t m_WaterVertexCount = 0;
 
 	bool m_isFullyLoaded = false;
 
+	// Frame the chunk was last inside the render distance, for least recently used unloading
+	uint64_t m_LastSeenFrame = 0;
+
 	// Helper methods
 	bool IsAir(int x, int y, int z);
 	static bool IsSolid(BlockType type);
 	static BlockType GetBlockTypeFromData(const ChunkData& data, int x, int y, int z);
 	static BlockType GetBlockTypeFromData(const PaddedChunkData& data, int x, int y, int z);
 
-	static void CreateBlockWorker(const ChunkData& data, glm::ivec2 chunkPos,
-		std::vector<Vertex>& vertices,
-		std::vector<unsigned int>& indices,
-		int x, int y, int z);
+	// Emits one quad for the given face covering size blocks starting at block start
+	static void EmitQuad(std::vector<Vertex>& vertices,
+		BlockType blockType, int face, glm::ivec3 start, glm::ivec3 size);
+
+	// Per column bit masks of the padded data, see ColumnMask. Indexed [x][z] in padded coordinates.
+	struct ColumnMasks {
+		ColumnMask opaque[WIDTH + 2][WIDTH + 2];	// IsSolid, hides faces of neighbors
+		ColumnMask solid[WIDTH + 2][WIDTH + 2];		// Meshed into the solid layer (not air and not water)
+		ColumnMask water[WIDTH + 2][WIDTH + 2];
+	};
+
+	// Visible faces per face direction and column, indexed [face][x][z]
+	struct FaceMasks {
+		ColumnMask solid[FACE_COUNT][WIDTH][WIDTH];
+		ColumnMask water[FACE_COUNT][WIDTH][WIDTH];
+	};
+
+	// Everything meshing needs besides the output, one per thread
+	struct MeshScratch {
+		PaddedChunkData padded;
+		ColumnMasks columns;
+		FaceMasks faces;
+	};
+
+	static MeshScratch& GetThreadScratch();
+
+	// Only rows [minY, maxY) are read from the blocks. Every mask is overwritten completely, rows outside the range are 0.
+	static void BuildColumnMasks(const PaddedChunkData& data, int minY, int maxY, ColumnMasks& columns);
+	static void BuildFaceMasks(const ColumnMasks& columns, const ColumnMask& meshedRange, FaceMasks& faces);
+
+	// One quad per visible face in range
+	static void EmitFaces(const PaddedChunkData& data, const ColumnMask (&faces)[FACE_COUNT][WIDTH][WIDTH], const ColumnMask& range,
+		std::vector<Vertex>& vertices);
 
-	static void CreateBlockWorker(const PaddedChunkData& data, glm::ivec2 chunkPos,
+	static void GreedyMeshLayer(const PaddedChunkData& data, const FaceMasks& faces,
 		std::vector<Vertex>& vertices,
-		std::vector<unsigned int>& indices,
-		int x, int y, int z);
+		int y);
 
-	static void GenerateMeshWorker(Chunk* chunk, const PaddedChunkData data, glm::ivec2 position);
+	// Only rows [minY, maxY) are filled
+	static void FillPaddedData(const MeshInput& input, PaddedChunkData& padded, int minY = 0, int maxY = HEIGHT);
+	static bool IsSectionHidden(const MeshInput& input, int sectionIndex);
+
+	// Meshes the sections set in the sections bit mask. Vertices are grouped by section in order, counts gets how many each section has.
+	// bounds gets the height range of each meshed section.
+	static void MeshSections(const MeshInput& input, uint32_t sections, MeshScratch& scratch,
+		std::vector<Vertex>& solid, SectionCounts& solidCounts,
+		std::vector<Vertex>& water, SectionCounts& waterCounts,
+		SectionBounds& bounds);
+
+	void SetSectionBounds(const SectionBounds& bounds, uint32_t sections);
+
+	static void ComputeVisibility(const ChunkData& data, uint32_t sections, SectionVisibilities& visibility);
+	void SetSectionVisibility(const SectionVisibilities& visibility, uint32_t sections);
+	static void ComputeOccluders(const ChunkData& data, OccluderHeights& heights);
+	static void GenerateMeshWorker(Chunk* chunk, const MeshInput& input, MeshBufferPool& pool);
+
+	MeshInput BuildMeshInput(World* world) const;
+
+	// Uploads a full mesh into a new buffer with a slot per section
+	static void UploadLayer(const std::vector<Vertex>& vertices, const SectionCounts& counts, ChunkMeshArena& arena, MeshLayout& layout);
+	static bool FitsLayout(const SectionCounts& counts, uint32_t sections, const MeshLayout& layout);
+	static void PatchLayer(const std::vector<Vertex>& vertices, const SectionCounts& counts, uint32_t sections, ChunkMeshArena& arena, MeshLayout& layout);
+
+	// Remeshes the given sections on the calling thread and writes them into the existing buffers.
+	// Returns false if they don't fit into their slots anymore, then the chunk needs a full remesh.
+	bool RemeshSections(World* world, uint32_t sections);
 
 public:
 	Chunk(glm::ivec2 position);
-	~Chunk();
 
 	void Update(World* world);
 
-	void Render(Renderer& renderer, Shader& shader, int layer);
+	// A finished mesh job waits here until the world has upload budget left for it, see World::UpdatePendingChunks
+	bool HasNewMesh() const { return m_HasNewMesh; }
+
+	// Creates the GL buffers for the new mesh, returns the uploaded bytes
+	size_t UploadNewMesh(World* world);
+
+	// Adds the mesh of the layer (0 solid, 2 water) to the worlds draw list, if there is one.
+	// Only the sections set in the mask are drawn, consecutive ones with a single command.
+	void AppendDrawCommand(int layer, std::vector<ChunkMeshArena::DrawCommand>& commands, uint32_t sections = ALL_SECTIONS) const;
 
 	void SetBlock(int x, int y, int z, BlockType blockType);
 	BlockType GetBlockType(int x, int y, int z);
 	void SetSelectedBlock(bool hasBlock, glm::ivec3 position);
 
-	bool IsTerrainGenerated() const { return m_IsTerrainGenerated; }
-	void SetTerrainGenerated(bool generated) { m_IsTerrainGenerated = generated; }
+	ChunkState GetState() const { return m_State; }
+	void SetState(ChunkState state) { m_State = state; }
+	bool IsTerrainGenerated() const { return m_State >= ChunkState::DECORATED; }
+	uint32_t GetMeshJobCount() const { return m_MeshJobCount; }
+
+	uint32_t GetJobEpoch() const { return m_JobEpoch; }
+	bool IsJobCurrent(uint32_t epoch) const { return m_JobEpoch == epoch; }
+	void CancelJobs() { m_JobEpoch++; }
 
 	static float GetLightLevelAt(int x, int y, int z, const ChunkData& data);
 
@@ -119,4 +357,42 @@ public:
 	void SetIsFullyLoaded(bool loaded) { m_isFullyLoaded = loaded; }
 
 	void SetIsDirty(bool dirty) { m_IsDirty = dirty; }
+	void MarkSectionDirty(int section) { m_DirtySections |= 1u << section; }
+
+	// True while Update has something to do. A running mesh job doesnt count, the world gets told when it finishes.
+	// Chunks that arent READY yet only get meshed once their neighbors are there.
+	bool NeedsUpdate() const { return m_HasNewMesh || (m_State >= ChunkState::READY && !m_IsGenerating && (m_IsDirty || m_DirtySections != 0)); }
+
+	glm::ivec2 GetChunkPosition() const { return m_ChunkPosition; }
+
+	// Frees the meshes in the arena, has to run on the main thread. The chunk itself might be freed later by a job still holding it.
+	void ReleaseGPUResources(ChunkMeshArena& arena);
+
+	// Blocks plus mesh vertices on the GPU
+	size_t GetMemoryUsage() const;
+
+	uint64_t GetLastSeenFrame() const { return m_LastSeenFrame; }
+	void SetLastSeenFrame(uint64_t frame) { m_LastSeenFrame = frame; }
+
+	// World space box around the uploaded geometry of the given sections, false if there is none
+	bool GetMeshBounds(glm::vec3& boxMin, glm::vec3& boxMax, uint32_t sections = ALL_SECTIONS) const;
+	const SectionBounds& GetSectionBounds() const { return m_SectionBounds; }
+	uint32_t GetMeshSections() const { return m_MeshSections; }
+
+	SectionVisibility GetSectionVisibility(int section) const { return m_SectionVisibility[section]; }
+	// Overrides what the last mesh computed until the next one, for tests
+	void SetSectionVisibility(int section, SectionVisibility visibility) { m_SectionVisibility[section] = visibility; }
+	OcclusionState& GetOcclusionState() { return m_OcclusionState; }
+	const OccluderHeights& GetOccluderHeights() const { return m_Occluders; }
+
+	size_t GetSolidVertexCount() const { return m_SolidVertexCount; }
+	size_t GetWaterVertexCount() const { return m_WaterVertexCount; }
+
+	// Shrinks the block palette after generation, see BlockStorage::Compact
+	void CompactBlocks();
+	size_t GetBlockMemoryUsage() const { return m_Blocks->GetMemoryUsage(); }
+
+	// Cheap, only copies a pointer. Call from the thread that owns the chunks blocks (main thread once generated).
+	BlockSnapshot GetBlockSnapshot() const { return m_Blocks; }
+	uint32_t GetBlockVersion() const { return m_Blocks->version; }
 };
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "ChunkCuller.h"
+
+#include <algorithm>
+
+int ChunkCuller::RegionIndex(int level, glm::ivec2 coord) const
+{
+    int mask = m_Levels[level].size - 1;
+    int shift = LEVEL_SHIFT[level];
+    return ((coord.x >> shift) & mask) * m_Levels[level].size + ((coord.y >> shift) & mask);
+}
+
+void ChunkCuller::Begin(int gridSize)
+{
+    m_Chunks.clear();
+    m_ChunkBoxes.clear();
+    m_ChunkRegions.clear();
+    m_Stats = Stats();
+
+    for (int level = 0; level < LEVEL_COUNT; level++)
+    {
+        Level& regions = m_Levels[level];
+        regions.size = std::max(gridSize >> LEVEL_SHIFT[level], 1);
+        regions.regions.assign((size_t)regions.size * regions.size, Region{ {}, -1, CameraFrustum::INTERSECT, false });
+        regions.used.clear();
+    }
+}
+
+void ChunkCuller::Add(Chunk* chunk, glm::ivec2 coord, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    m_Chunks.push_back(chunk);
+    m_ChunkBoxes.push_back({ boxMin, boxMax });
+    m_ChunkRegions.push_back(RegionIndex(0, coord));
+
+    for (int level = 0; level < LEVEL_COUNT; level++)
+    {
+        Level& regions = m_Levels[level];
+        int index = RegionIndex(level, coord);
+        Region& region = regions.regions[index];
+
+        if (!region.used)
+        {
+            region.used = true;
+            region.box = { boxMin, boxMax };
+            region.parent = level + 1 < LEVEL_COUNT ? RegionIndex(level + 1, coord) : -1;
+            regions.used.push_back(index);
+        }
+        else
+        {
+            region.box.min = glm::min(region.box.min, boxMin);
+            region.box.max = glm::max(region.box.max, boxMax);
+        }
+    }
+}
+
+void ChunkCuller::Cull(const Camera& camera, bool hierarchical, std::vector<Chunk*>& visible)
+{
+    if (hierarchical)
+    {
+        // Top down, a region only needs a test if its parent crosses the frustum
+        for (int level = LEVEL_COUNT - 1; level >= 0; level--)
+        {
+            Level& regions = m_Levels[level];
+            const Level* parents = level + 1 < LEVEL_COUNT ? &m_Levels[level + 1] : nullptr;
+
+            m_Batch.Clear();
+            m_BatchItems.clear();
+
+            for (int index : regions.used)
+            {
+                Region& region = regions.regions[index];
+                region.result = parents ? parents->regions[region.parent].result : (uint8_t)CameraFrustum::INTERSECT;
+
+                if (region.result == CameraFrustum::INTERSECT)
+                {
+                    m_Batch.Add(region.box.min, region.box.max);
+                    m_BatchItems.push_back(index);
+                }
+            }
+
+            camera.FrustumTestBoxes(m_Batch, m_Results);
+            for (size_t i = 0; i < m_BatchItems.size(); i++)
+                regions.regions[m_BatchItems[i]].result = m_Results[i];
+
+            m_Stats.regionTests += (int)m_BatchItems.size();
+        }
+    }
+
+    // Chunks of regions that cross the frustum are tested, the others take the result of their region
+    m_Batch.Clear();
+    m_BatchItems.clear();
+
+    for (size_t i = 0; i < m_Chunks.size(); i++)
+    {
+        uint8_t result = hierarchical ? m_Levels[0].regions[m_ChunkRegions[i]].result : (uint8_t)CameraFrustum::INTERSECT;
+
+        if (result == CameraFrustum::INTERSECT)
+        {
+            m_Batch.Add(m_ChunkBoxes[i].min, m_ChunkBoxes[i].max);
+            m_BatchItems.push_back((int)i);
+        }
+        else if (result == CameraFrustum::INSIDE)
+        {
+            visible.push_back(m_Chunks[i]);
+            m_Stats.inside++;
+        }
+    }
+
+    camera.FrustumTestBoxes(m_Batch, m_Results);
+    m_Stats.chunkTests = (int)m_BatchItems.size();
+
+    for (size_t i = 0; i < m_BatchItems.size(); i++)
+    {
+        if (m_Results[i] == CameraFrustum::OUTSIDE)
+            continue;
+
+        if (m_Results[i] == CameraFrustum::INSIDE)
+            m_Stats.inside++;
+        visible.push_back(m_Chunks[m_BatchItems[i]]);
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm.hpp>
+
+#include "../Camera.h"
+#include "../CameraFrustum.h"
+
+class Chunk;
+
+/*
+* Frustum culling of the loaded chunks through two levels of regions, 16x16 and 4x4 chunks.
+* A region's box is the union of the boxes of its chunks, collected while the chunks are added.
+* The regions are tested top down: OUTSIDE rejects all of their chunks in one test, INSIDE accepts them without any test,
+* only children of INTERSECT regions are tested themselves.
+*
+* Regions are indexed like ChunkGrid slots (region coordinate mod size), so nothing is rebuilt when the window moves.
+* Chunks far apart that end up in the same region only make its box bigger.
+*/
+class ChunkCuller
+{
+public:
+	struct Stats {
+		int regionTests = 0;
+		int chunkTests = 0;
+		int inside = 0;		// Visible chunks completely inside the frustum
+	};
+
+	// gridSize is ChunkGrid::GetSize, the chunks added until the next Begin must fit into a window that size
+	void Begin(int gridSize);
+	void Add(Chunk* chunk, glm::ivec2 coord, const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+	// Appends every added chunk that is at least partially inside the frustum.
+	// Not hierarchical tests all chunks one by one, for comparison.
+	void Cull(const Camera& camera, bool hierarchical, std::vector<Chunk*>& visible);
+
+	const std::vector<Chunk*>& GetChunks() const { return m_Chunks; }
+	Stats GetStats() const { return m_Stats; }
+
+private:
+	static constexpr int LEVEL_COUNT = 2;
+
+	// Region size in chunks per level as a shift, 4x4 and 16x16
+	static constexpr int LEVEL_SHIFT[LEVEL_COUNT] = { 2, 4 };
+
+	struct Region {
+		AABox box;
+		int parent;		// Region in the next level, -1 for the top level
+		uint8_t result;
+		bool used;
+	};
+
+	struct Level {
+		int size = 1;	// Regions per axis, power of two
+		std::vector<Region> regions;
+		std::vector<int> used;	// Indices of the used regions, in the order they were first added to
+	};
+
+	Level m_Levels[LEVEL_COUNT];
+
+	std::vector<Chunk*> m_Chunks;
+	std::vector<AABox> m_ChunkBoxes;
+	std::vector<int> m_ChunkRegions; // Region in level 0 of every chunk
+
+	// Reused by every test
+	AABoxBatch m_Batch;
+	std::vector<int> m_BatchItems;
+	std::vector<uint8_t> m_Results;
+
+	Stats m_Stats;
+
+	int RegionIndex(int level, glm::ivec2 coord) const;
+};
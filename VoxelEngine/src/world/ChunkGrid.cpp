@@ -0,0 +1,99 @@
+#include "ChunkGrid.h"
+#include "Chunk.h"
+
+static int SizeLog2ForRadius(int radius)
+{
+    int log2 = 1;
+    while ((1 << log2) < 2 * radius + 1)
+        log2++;
+    return log2;
+}
+
+ChunkGrid::ChunkGrid(int radius)
+{
+    auto table = std::make_unique<Table>();
+    table->sizeLog2 = SizeLog2ForRadius(radius);
+    table->mask = (1 << table->sizeLog2) - 1;
+    table->slots = std::make_unique<Slot[]>((size_t)1 << (table->sizeLog2 * 2));
+
+    m_Table = table.get();
+    m_Tables.push_back(std::move(table));
+}
+
+void ChunkGrid::WriteSlot(Slot& slot, glm::ivec2 coord, std::shared_ptr<Chunk> chunk)
+{
+    // Odd generation while writing, readers that see it or see it change retry
+    uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+    slot.generation.store(generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.key.store(Key(coord), std::memory_order_relaxed);
+    slot.chunk.store(chunk.get(), std::memory_order_relaxed);
+
+    slot.generation.store(generation + 2, std::memory_order_release);
+    slot.owner = std::move(chunk);
+}
+
+std::shared_ptr<Chunk> ChunkGrid::Insert(glm::ivec2 coord, std::shared_ptr<Chunk> chunk)
+{
+    Table& table = *m_Table.load(std::memory_order_relaxed);
+    Slot& slot = table.slots[Index(table, coord)];
+
+    std::shared_ptr<Chunk> displaced = std::move(slot.owner);
+    if (!displaced)
+        m_Count++;
+
+    WriteSlot(slot, coord, std::move(chunk));
+    return displaced;
+}
+
+std::shared_ptr<Chunk> ChunkGrid::Remove(glm::ivec2 coord)
+{
+    Table& table = *m_Table.load(std::memory_order_relaxed);
+    Slot& slot = table.slots[Index(table, coord)];
+
+    if (!slot.owner || slot.key.load(std::memory_order_relaxed) != Key(coord))
+        return nullptr;
+
+    std::shared_ptr<Chunk> removed = std::move(slot.owner);
+    WriteSlot(slot, coord, nullptr);
+    m_Count--;
+    return removed;
+}
+
+std::vector<std::shared_ptr<Chunk>> ChunkGrid::Reserve(int radius)
+{
+    std::vector<std::shared_ptr<Chunk>> displaced;
+
+    int sizeLog2 = SizeLog2ForRadius(radius);
+    Table& oldTable = *m_Table.load(std::memory_order_relaxed);
+    if (sizeLog2 <= oldTable.sizeLog2)
+        return displaced;
+
+    auto table = std::make_unique<Table>();
+    table->sizeLog2 = sizeLog2;
+    table->mask = (1 << sizeLog2) - 1;
+    table->slots = std::make_unique<Slot[]>((size_t)1 << (sizeLog2 * 2));
+
+    int oldSlotCount = 1 << (oldTable.sizeLog2 * 2);
+    for (int i = 0; i < oldSlotCount; i++)
+    {
+        std::shared_ptr<Chunk> chunk = std::move(oldTable.slots[i].owner);
+        if (!chunk)
+            continue;
+
+        glm::ivec2 coord = chunk->GetChunkPosition();
+        Slot& slot = table->slots[Index(*table, coord)];
+        if (slot.owner)
+        {
+            displaced.push_back(std::move(slot.owner));
+            m_Count--;
+        }
+        WriteSlot(slot, coord, std::move(chunk));
+    }
+
+    // Readers of the old table still find valid (if stale) pointers, the chunks are alive as long as the new table owns them
+    m_Table.store(table.get(), std::memory_order_release);
+    m_Tables.push_back(std::move(table));
+    return displaced;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <glm.hpp>
+
+class Chunk;
+
+/*
+* Loaded chunks in a toroidal 2D array. A chunk lives in slot (x mod size, z mod size), so the slots wrap around
+* as the loaded window moves and nothing has to be rehashed. The size is a power of two bigger than the window,
+* two loaded chunks can only share a slot if one of them is far outside of it.
+*
+* Only the main thread uses the grid: chunk loading and promotion, block edits and raycasts, gathering the neighbor
+* snapshots for mesh jobs and culling. Jobs get everything they need up front and never look chunks up themselves.
+* Get still doesnt lock and would be safe to call from another thread: every slot has a generation counter that is odd
+* while the slot is being rewritten, a reader retries if it changed while reading. Its raw pointers are only valid
+* until the main thread unloads the chunk though.
+*/
+class ChunkGrid
+{
+private:
+	struct Slot
+	{
+		std::atomic<uint32_t> generation{ 0 };
+		std::atomic<uint64_t> key{ 0 };
+		std::atomic<Chunk*> chunk{ nullptr };
+		std::shared_ptr<Chunk> owner; // Main thread only
+	};
+
+	struct Table
+	{
+		int sizeLog2;
+		int mask;
+		std::unique_ptr<Slot[]> slots;
+	};
+
+	std::atomic<Table*> m_Table{ nullptr };
+
+	// Tables replaced by Reserve. Another thread might still be reading one, they are kept until the grid is destroyed.
+	std::vector<std::unique_ptr<Table>> m_Tables;
+
+	size_t m_Count = 0;
+
+	static uint64_t Key(glm::ivec2 coord) { return ((uint64_t)(uint32_t)coord.x << 32) | (uint32_t)coord.y; }
+	static int Index(const Table& table, glm::ivec2 coord) { return ((coord.x & table.mask) << table.sizeLog2) | (coord.y & table.mask); }
+
+	static void WriteSlot(Slot& slot, glm::ivec2 coord, std::shared_ptr<Chunk> chunk);
+
+public:
+	// Enough slots for every chunk within radius of a center
+	explicit ChunkGrid(int radius);
+
+	ChunkGrid(const ChunkGrid&) = delete;
+	ChunkGrid& operator=(const ChunkGrid&) = delete;
+
+	inline Chunk* Get(glm::ivec2 coord) const
+	{
+		const Table& table = *m_Table.load(std::memory_order_acquire);
+		const Slot& slot = table.slots[Index(table, coord)];
+
+		for (;;)
+		{
+			uint32_t generation = slot.generation.load(std::memory_order_acquire);
+			if (generation & 1)
+				continue; // Main thread is in the middle of writing, only takes a couple of stores
+
+			uint64_t key = slot.key.load(std::memory_order_relaxed);
+			Chunk* chunk = slot.chunk.load(std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.generation.load(std::memory_order_relaxed) == generation)
+				return key == Key(coord) ? chunk : nullptr;
+		}
+	}
+
+	// Main thread only. Returns the chunk that had to make room, if any, its owner has to unload it.
+	std::shared_ptr<Chunk> Insert(glm::ivec2 coord, std::shared_ptr<Chunk> chunk);
+	std::shared_ptr<Chunk> Remove(glm::ivec2 coord);
+
+	// Main thread only. Grows the grid if radius doesnt fit anymore, returns chunks that didnt fit into the new one.
+	std::vector<std::shared_ptr<Chunk>> Reserve(int radius);
+
+	size_t GetCount() const { return m_Count; }
+	int GetSize() const { return 1 << m_Table.load(std::memory_order_relaxed)->sizeLog2; }
+
+	// Main thread only. Calls fn(const std::shared_ptr<Chunk>&) for every loaded chunk, in slot order.
+	template<typename Fn>
+	void ForEach(Fn&& fn) const
+	{
+		const Table& table = *m_Table.load(std::memory_order_relaxed);
+		int slotCount = 1 << (table.sizeLog2 * 2);
+
+		for (int i = 0; i < slotCount; i++)
+		{
+			if (table.slots[i].owner)
+				fn(table.slots[i].owner);
+		}
+	}
+};
@@ -0,0 +1,192 @@
+#include "ChunkMeshArena.h"
+
+#include "Chunk.h"
+#include "../Renderer.h"
+#include "../VertexBufferLayout.h"
+
+#include <algorithm>
+
+// Chunk origin attribute, see vertex.shader and water_vertex.shader
+static constexpr unsigned int ORIGIN_LOCATION = 2;
+
+ChunkMeshArena::ChunkMeshArena(uint32_t initialVertices)
+{
+    m_MultiDrawIndirect = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+
+    m_Capacity = initialVertices & ~3u;
+    m_VB = std::make_unique<VertexBuffer>(nullptr, m_Capacity * (unsigned int)sizeof(Vertex), true);
+    m_OriginBuffer = std::make_unique<VertexBuffer>(nullptr, 0, true);
+    AddFreeBlock(0, m_Capacity);
+
+    if (m_MultiDrawIndirect)
+    {
+        GLCall(glGenBuffers(1, &m_IndirectBuffer));
+    }
+
+    CreateVertexArray();
+}
+
+ChunkMeshArena::~ChunkMeshArena()
+{
+    if (m_IndirectBuffer)
+    {
+        GLCall(glDeleteBuffers(1, &m_IndirectBuffer));
+    }
+}
+
+void ChunkMeshArena::CreateVertexArray()
+{
+    m_VA = std::make_unique<VertexArray>();
+
+    // See Vertex for the bit layout
+    VertexBufferLayout layout;
+    layout.PushInteger<unsigned int>(1); // Position, AO, Light
+    layout.PushInteger<unsigned int>(1); // Atlas Tile, U, V
+    m_VA->AddBuffer(*m_VB, layout);
+
+    // The fallback sets the origin as a constant attribute per draw instead
+    if (m_MultiDrawIndirect)
+    {
+        VertexBufferLayout originLayout;
+        originLayout.PushPerInstance<float>(3);
+        m_VA->AddBuffer(*m_OriginBuffer, originLayout);
+    }
+}
+
+void ChunkMeshArena::AddFreeBlock(uint32_t offset, uint32_t size)
+{
+    auto it = m_FreeBlocks.emplace(offset, size).first;
+
+    // Merge with the next block
+    auto next = std::next(it);
+    if (next != m_FreeBlocks.end() && it->first + it->second == next->first)
+    {
+        it->second += next->second;
+        m_FreeBlocks.erase(next);
+    }
+
+    // And with the previous one
+    if (it != m_FreeBlocks.begin())
+    {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first)
+        {
+            prev->second += it->second;
+            m_FreeBlocks.erase(it);
+        }
+    }
+}
+
+ChunkMeshArena::Allocation ChunkMeshArena::Allocate(uint32_t vertexCount)
+{
+    vertexCount = (vertexCount + 3) & ~3u;
+    if (vertexCount == 0)
+        return {};
+
+    auto fit = std::find_if(m_FreeBlocks.begin(), m_FreeBlocks.end(), [vertexCount](const auto& block) {
+        return block.second >= vertexCount;
+    });
+
+    if (fit == m_FreeBlocks.end())
+    {
+        Grow(m_Capacity + vertexCount);
+        return Allocate(vertexCount);
+    }
+
+    Allocation allocation{ fit->first, vertexCount };
+    uint32_t remaining = fit->second - vertexCount;
+    m_FreeBlocks.erase(fit);
+
+    if (remaining > 0)
+        m_FreeBlocks.emplace(allocation.offset + vertexCount, remaining);
+
+    m_Used += vertexCount;
+    return allocation;
+}
+
+void ChunkMeshArena::Free(const Allocation& allocation)
+{
+    if (allocation.size == 0)
+        return;
+
+    m_Used -= allocation.size;
+    AddFreeBlock(allocation.offset, allocation.size);
+}
+
+void ChunkMeshArena::Grow(uint32_t minCapacity)
+{
+    uint32_t capacity = std::max(m_Capacity * 2, (minCapacity + 3) & ~3u);
+
+    // Copy everything on the GPU, offsets of existing allocations stay the same
+    auto vb = std::make_unique<VertexBuffer>(nullptr, capacity * (unsigned int)sizeof(Vertex), true);
+    GLCall(glBindBuffer(GL_COPY_READ_BUFFER, m_VB->GetRendererID()));
+    GLCall(glBindBuffer(GL_COPY_WRITE_BUFFER, vb->GetRendererID()));
+    GLCall(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_Capacity * sizeof(Vertex)));
+
+    AddFreeBlock(m_Capacity, capacity - m_Capacity);
+    m_Capacity = capacity;
+    m_VB = std::move(vb);
+
+    CreateVertexArray();
+}
+
+void ChunkMeshArena::Upload(uint32_t offset, const void* vertices, uint32_t count)
+{
+    if (count == 0)
+        return;
+
+    m_VB->SetSubData(offset * (unsigned int)sizeof(Vertex), vertices, count * (unsigned int)sizeof(Vertex));
+}
+
+void ChunkMeshArena::Draw(Renderer& renderer, std::span<const DrawCommand> commands)
+{
+    m_LastDraws = (int)commands.size();
+    if (commands.empty())
+        return;
+
+    uint32_t maxQuads = 0;
+    for (const DrawCommand& command : commands)
+        maxQuads = std::max(maxQuads, command.vertexCount / 4);
+
+    // Indices are relative to each mesh (baseVertex), so the quad index buffer only has to cover the biggest one
+    m_VA->Bind();
+    unsigned int indexType = renderer.BindQuadIndices(maxQuads);
+
+    if (!m_MultiDrawIndirect)
+    {
+        for (const DrawCommand& command : commands)
+        {
+            GLCall(glVertexAttrib3f(ORIGIN_LOCATION, command.origin.x, command.origin.y, command.origin.z));
+            GLCall(glDrawElementsBaseVertex(GL_TRIANGLES, command.vertexCount / 4 * 6, indexType, nullptr, command.offset));
+        }
+        return;
+    }
+
+    m_Commands.clear();
+    m_Origins.clear();
+    for (const DrawCommand& command : commands)
+    {
+        // baseInstance picks this draws origin from the instance attribute
+        m_Commands.push_back({ command.vertexCount / 4 * 6, 1, 0, (int32_t)command.offset, (uint32_t)m_Origins.size() });
+        m_Origins.push_back(command.origin);
+    }
+
+    // Respecified every frame, the driver can hand out fresh memory instead of waiting for the last frames draws
+    m_OriginBuffer->SetData(m_Origins.data(), (unsigned int)(m_Origins.size() * sizeof(glm::vec3)));
+
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer));
+    GLCall(glBufferData(GL_DRAW_INDIRECT_BUFFER, m_Commands.size() * sizeof(IndirectCommand), m_Commands.data(), GL_STREAM_DRAW));
+    GLCall(glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, nullptr, (GLsizei)m_Commands.size(), 0));
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+}
+
+ChunkMeshArena::Stats ChunkMeshArena::GetStats() const
+{
+    Stats stats;
+    stats.capacityBytes = (size_t)m_Capacity * sizeof(Vertex);
+    stats.usedBytes = (size_t)m_Used * sizeof(Vertex);
+    stats.freeBlocks = m_FreeBlocks.size();
+    stats.draws = m_LastDraws;
+    stats.multiDrawIndirect = m_MultiDrawIndirect;
+    return stats;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <span>
+#include <vector>
+#include <glm.hpp>
+
+#include "../VertexArray.h"
+#include "../VertexBuffer.h"
+
+class Renderer;
+
+/*
+* One big vertex buffer for every chunk mesh.
+* Chunks allocate ranges of it (first fit free list, neighbors are merged again on free), the buffer doubles when nothing fits.
+* Because all meshes share one VAO and the quad index buffer, a frame is drawn with a single glMultiDrawElementsIndirect.
+* Every draw reads its chunk origin as a per instance attribute through baseInstance.
+*
+* Without GL 4.3 / ARB_multi_draw_indirect + ARB_base_instance the draws are issued one by one with glDrawElementsBaseVertex,
+* still without rebinding anything in between.
+*/
+class ChunkMeshArena
+{
+public:
+	// Vertices, always whole quads
+	struct Allocation {
+		uint32_t offset = 0;
+		uint32_t size = 0;
+	};
+
+	// One mesh to draw. vertexCount is a multiple of 4
+	struct DrawCommand {
+		uint32_t offset;
+		uint32_t vertexCount;
+		glm::vec3 origin;
+	};
+
+	struct Stats {
+		size_t capacityBytes = 0;
+		size_t usedBytes = 0;
+		size_t freeBlocks = 0;
+		int draws = 0;		// Meshes drawn in the last Draw
+		bool multiDrawIndirect = false;
+	};
+
+	explicit ChunkMeshArena(uint32_t initialVertices = 1u << 20);
+	~ChunkMeshArena();
+
+	ChunkMeshArena(const ChunkMeshArena&) = delete;
+	ChunkMeshArena& operator=(const ChunkMeshArena&) = delete;
+
+	// Main thread only, like everything else here
+	Allocation Allocate(uint32_t vertexCount);
+	void Free(const Allocation& allocation);
+
+	// Writes count vertices starting at vertex offset
+	void Upload(uint32_t offset, const void* vertices, uint32_t count);
+
+	void Draw(Renderer& renderer, std::span<const DrawCommand> commands);
+
+	Stats GetStats() const;
+
+private:
+	// Same layout as DrawElementsIndirectCommand in the GL spec
+	struct IndirectCommand {
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+
+	uint32_t m_Capacity = 0;
+	uint32_t m_Used = 0;
+
+	// Free ranges, offset -> size
+	std::map<uint32_t, uint32_t> m_FreeBlocks;
+
+	std::unique_ptr<VertexBuffer> m_VB;
+	std::unique_ptr<VertexBuffer> m_OriginBuffer;
+	std::unique_ptr<VertexArray> m_VA;
+	unsigned int m_IndirectBuffer = 0;
+
+	bool m_MultiDrawIndirect = false;
+	int m_LastDraws = 0;
+
+	// Reused every frame
+	std::vector<IndirectCommand> m_Commands;
+	std::vector<glm::vec3> m_Origins;
+
+	void Grow(uint32_t minCapacity);
+	void CreateVertexArray();
+	void AddFreeBlock(uint32_t offset, uint32_t size);
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOXEL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/*
+* One bit per block over the full height of a chunk column (128 blocks), bit y = block at height y.
+* The mesher builds these for every column and derives visible faces with a couple of ANDs and shifts
+* instead of looking at every neighbor of every block.
+*/
+struct alignas(16) ColumnMask
+{
+	uint64_t lo = 0; // y 0..63
+	uint64_t hi = 0; // y 64..127
+
+	void Set(int y) { (y < 64 ? lo : hi) |= 1ull << (y & 63); }
+	bool Test(int y) const { return ((y < 64 ? lo : hi) >> (y & 63)) & 1; }
+	bool Any() const { return (lo | hi) != 0; }
+
+	// Bits [minY, maxY) set
+	static ColumnMask Range(int minY, int maxY)
+	{
+		ColumnMask m;
+		for (int y = minY; y < maxY; y++)
+			m.Set(y);
+		return m;
+	}
+
+	// Calls fn(y) for every set bit, lowest first
+	template<typename Fn>
+	void ForEachBit(Fn&& fn) const
+	{
+		for (uint64_t bits = lo; bits; bits &= bits - 1)
+			fn(std::countr_zero(bits));
+		for (uint64_t bits = hi; bits; bits &= bits - 1)
+			fn(64 + std::countr_zero(bits));
+	}
+};
+
+#if VOXEL_SSE2
+inline __m128i LoadMask(const ColumnMask& m) { return _mm_load_si128(reinterpret_cast<const __m128i*>(&m)); }
+inline ColumnMask StoreMask(__m128i v) { ColumnMask m; _mm_store_si128(reinterpret_cast<__m128i*>(&m), v); return m; }
+#endif
+
+inline ColumnMask operator&(const ColumnMask& a, const ColumnMask& b)
+{
+#if VOXEL_SSE2
+	return StoreMask(_mm_and_si128(LoadMask(a), LoadMask(b)));
+#else
+	return { a.lo & b.lo, a.hi & b.hi };
+#endif
+}
+
+inline ColumnMask operator|(const ColumnMask& a, const ColumnMask& b)
+{
+#if VOXEL_SSE2
+	return StoreMask(_mm_or_si128(LoadMask(a), LoadMask(b)));
+#else
+	return { a.lo | b.lo, a.hi | b.hi };
+#endif
+}
+
+// a & ~b
+inline ColumnMask AndNot(const ColumnMask& a, const ColumnMask& b)
+{
+#if VOXEL_SSE2
+	return StoreMask(_mm_andnot_si128(LoadMask(b), LoadMask(a)));
+#else
+	return { a.lo & ~b.lo, a.hi & ~b.hi };
+#endif
+}
+
+// bit y = bit y + 1, so every block sees the one above it. Above the top is 0 (air).
+inline ColumnMask ShiftDown(const ColumnMask& m)
+{
+#if VOXEL_SSE2
+	__m128i v = LoadMask(m);
+	__m128i carry = _mm_slli_epi64(_mm_srli_si128(v, 8), 63); // lowest bit of hi moves to the top of lo
+	return StoreMask(_mm_or_si128(_mm_srli_epi64(v, 1), carry));
+#else
+	return { (m.lo >> 1) | (m.hi << 63), m.hi >> 1 };
+#endif
+}
+
+// bit y = bit y - 1, so every block sees the one below it. Below the bottom is 0 (air).
+inline ColumnMask ShiftUp(const ColumnMask& m)
+{
+#if VOXEL_SSE2
+	__m128i v = LoadMask(m);
+	__m128i carry = _mm_srli_epi64(_mm_slli_si128(v, 8), 63); // highest bit of lo moves to the bottom of hi
+	return StoreMask(_mm_or_si128(_mm_slli_epi64(v, 1), carry));
+#else
+	return { m.lo << 1, (m.hi << 1) | (m.lo >> 63) };
+#endif
+}
@@ -0,0 +1,53 @@
+#include "MeshBufferPool.h"
+
+std::vector<Vertex> MeshBufferPool::Acquire()
+{
+    m_Acquired++;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (!m_FreeBuffers.empty())
+        {
+            std::vector<Vertex> buffer = std::move(m_FreeBuffers.back());
+            m_FreeBuffers.pop_back();
+            return buffer;
+        }
+    }
+
+    m_Allocations++;
+    std::vector<Vertex> buffer;
+    buffer.reserve(INITIAL_CAPACITY);
+    return buffer;
+}
+
+void MeshBufferPool::Release(std::vector<Vertex>&& buffer)
+{
+    if (buffer.capacity() == 0)
+        return;
+
+    buffer.clear();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_FreeBuffers.size() < MAX_FREE_BUFFERS)
+        m_FreeBuffers.push_back(std::move(buffer));
+}
+
+void MeshBufferPool::TrackGrowth(size_t capacityBefore, const std::vector<Vertex>& buffer)
+{
+    // Growing reallocates, usually once or twice per job until the pooled buffers are big enough
+    if (buffer.capacity() != capacityBefore)
+        m_Allocations++;
+}
+
+MeshBufferPool::Stats MeshBufferPool::GetStats()
+{
+    Stats stats;
+    stats.acquired = m_Acquired;
+    stats.allocations = m_Allocations;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    stats.freeBuffers = m_FreeBuffers.size();
+    for (const auto& buffer : m_FreeBuffers)
+        stats.freeBytes += buffer.capacity() * sizeof(Vertex);
+    return stats;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "Chunk.h"
+
+/*
+* Recycles the vertex vectors mesh jobs hand to their chunk.
+* A worker acquires a buffer, fills it and hands it to the chunk, the chunk releases it again after the GPU upload.
+* Buffers keep their capacity, so once enough of them are big enough remeshing does not touch the heap anymore.
+*/
+class MeshBufferPool
+{
+private:
+	std::mutex m_Mutex;
+	std::vector<std::vector<Vertex>> m_FreeBuffers;
+
+	std::atomic<uint64_t> m_Acquired{ 0 };
+	std::atomic<uint64_t> m_Allocations{ 0 };
+
+	// Upper bound of idle buffers, anything above is freed instead of kept around
+	static constexpr size_t MAX_FREE_BUFFERS = 64;
+	static constexpr size_t INITIAL_CAPACITY = 8192;
+
+public:
+	std::vector<Vertex> Acquire();
+	void Release(std::vector<Vertex>&& buffer);
+
+	// Call after filling an acquired buffer, counts it as an allocation if it had to grow
+	void TrackGrowth(size_t capacityBefore, const std::vector<Vertex>& buffer);
+
+	struct Stats {
+		uint64_t acquired = 0;		// Buffers handed out
+		uint64_t allocations = 0;	// New buffers plus buffers that had to grow while being filled
+		size_t freeBuffers = 0;
+		size_t freeBytes = 0;
+	};
+	Stats GetStats();
+};
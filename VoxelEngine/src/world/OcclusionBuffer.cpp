@@ -0,0 +1,381 @@
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <thread>
+
+OcclusionBuffer::OcclusionBuffer()
+{
+    // Nothing drawn yet, for the debug view before the first frame
+    std::fill(std::begin(m_Depth), std::end(m_Depth), 1.0f);
+    std::fill(std::begin(m_TileMax), std::end(m_TileMax), 1.0f);
+}
+
+uint64_t OcclusionBuffer::Begin(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition)
+{
+    m_Projection = projection;
+    m_ViewProjection = projection * view;
+    m_CameraPosition = cameraPosition;
+
+    m_Triangles.clear();
+    m_Stats = Stats();
+    m_WorkerBands = 0;
+
+    return ++m_Frame;
+}
+
+void OcclusionBuffer::AddOccluder(const glm::vec3& boxMin, const glm::vec3& boxMax, const float* sideBottom)
+{
+    m_Stats.occluders++;
+
+    // A face is seen from the front if the camera is on its outer side, at most one face per axis
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float plane;
+        int side;
+        if (m_CameraPosition[axis] < boxMin[axis])
+        {
+            plane = boxMin[axis];
+            side = 0;
+        }
+        else if (m_CameraPosition[axis] > boxMax[axis])
+        {
+            plane = boxMax[axis];
+            side = 1;
+        }
+        else
+        {
+            continue;
+        }
+
+        glm::vec3 faceMin = boxMin;
+        if (sideBottom && axis != 1)
+        {
+            faceMin.y = std::max(faceMin.y, sideBottom[(axis == 2 ? 2 : 0) + side]);
+            if (faceMin.y >= boxMax.y)
+                continue;
+        }
+
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+
+        glm::vec3 corners[4];
+        for (int i = 0; i < 4; i++)
+        {
+            corners[i][axis] = plane;
+            corners[i][u] = (i == 1 || i == 2) ? boxMax[u] : faceMin[u];
+            corners[i][v] = (i >= 2) ? boxMax[v] : faceMin[v];
+        }
+
+        glm::vec4 clip[4];
+        for (int i = 0; i < 4; i++)
+            clip[i] = m_ViewProjection * glm::vec4(corners[i], 1.0f);
+
+        AddPolygon(clip, 4);
+    }
+}
+
+void OcclusionBuffer::AddPolygon(const glm::vec4* clip, int count)
+{
+    // Clip against the near plane (z >= -w), a quad gets at most one more corner
+    glm::vec4 clipped[8];
+    int clippedCount = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        const glm::vec4& a = clip[i];
+        const glm::vec4& b = clip[(i + 1) % count];
+        float da = a.z + a.w;
+        float db = b.z + b.w;
+
+        if (da >= 0.0f)
+            clipped[clippedCount++] = a;
+        if ((da >= 0.0f) != (db >= 0.0f))
+            clipped[clippedCount++] = a + (b - a) * (da / (da - db));
+    }
+
+    if (clippedCount < 3)
+        return;
+
+    glm::vec3 screen[8];
+    for (int i = 0; i < clippedCount; i++)
+    {
+        const glm::vec4& p = clipped[i];
+        if (p.w <= 1e-5f)
+            return;
+
+        float invW = 1.0f / p.w;
+        screen[i] = glm::vec3(
+            (p.x * invW * 0.5f + 0.5f) * WIDTH,
+            (p.y * invW * 0.5f + 0.5f) * HEIGHT,
+            p.z * invW);
+    }
+
+    // Convex, so a fan
+    for (int i = 1; i + 1 < clippedCount; i++)
+    {
+        Triangle triangle{ { screen[0], screen[i], screen[i + 1] } };
+
+        float minX = std::min({ screen[0].x, screen[i].x, screen[i + 1].x });
+        float maxX = std::max({ screen[0].x, screen[i].x, screen[i + 1].x });
+        float minY = std::min({ screen[0].y, screen[i].y, screen[i + 1].y });
+        float maxY = std::max({ screen[0].y, screen[i].y, screen[i + 1].y });
+
+        if (maxX < 0.0f || minX > (float)WIDTH)
+            continue;
+
+        // Rows whose pixel centers are in the bounds
+        triangle.minY = (int)std::ceil(std::clamp(minY - 0.5f, 0.0f, (float)HEIGHT));
+        triangle.maxY = (int)std::floor(std::clamp(maxY - 0.5f, -1.0f, (float)HEIGHT - 1.0f)) + 1;
+        if (triangle.minY >= triangle.maxY)
+            continue;
+
+        m_Triangles.push_back(triangle);
+        m_Stats.triangles++;
+    }
+}
+
+void OcclusionBuffer::RasterizeTriangle(const Triangle& triangle, int minRow, int maxRow)
+{
+    glm::vec3 v0 = triangle.v[0];
+    glm::vec3 v1 = triangle.v[1];
+    glm::vec3 v2 = triangle.v[2];
+
+    // Counter clockwise, so the edge functions are positive inside
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (area < 0.0f)
+    {
+        std::swap(v1, v2);
+        area = -area;
+    }
+    if (area < 1e-6f)
+        return;
+
+    float minX = std::min({ v0.x, v1.x, v2.x });
+    float maxX = std::max({ v0.x, v1.x, v2.x });
+    int firstX = (int)std::ceil(std::clamp(minX - 0.5f, 0.0f, (float)WIDTH));
+    int lastX = (int)std::floor(std::clamp(maxX - 0.5f, -1.0f, (float)WIDTH - 1.0f)) + 1;
+    if (firstX >= lastX)
+        return;
+
+    // Groups of 4 pixels, WIDTH is a multiple of 4 so the last group never leaves the row
+    firstX &= ~3;
+
+    // E(x, y) = A * (x - a.x) + B * (y - a.y) for the edge from a to b
+    const glm::vec3* edgeStart[3] = { &v0, &v1, &v2 };
+    const glm::vec3* edgeEnd[3] = { &v1, &v2, &v0 };
+    float edgeA[3], edgeB[3];
+    for (int i = 0; i < 3; i++)
+    {
+        edgeA[i] = edgeStart[i]->y - edgeEnd[i]->y;
+        edgeB[i] = edgeEnd[i]->x - edgeStart[i]->x;
+    }
+
+    // Depth is linear in screen space, z(x, y) = v0.z + dzdx * (x - v0.x) + dzdy * (y - v0.y)
+    float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+
+    float startX = (float)firstX + 0.5f;
+
+    for (int row = minRow; row < maxRow; row++)
+    {
+        float y = (float)row + 0.5f;
+        float* depth = m_Depth + row * WIDTH;
+
+        float edge[3];
+        for (int i = 0; i < 3; i++)
+            edge[i] = edgeA[i] * (startX - edgeStart[i]->x) + edgeB[i] * (y - edgeStart[i]->y);
+        float z = v0.z + dzdx * (startX - v0.x) + dzdy * (y - v0.y);
+
+#if VOXEL_SSE2
+        const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 zero = _mm_setzero_ps();
+
+        __m128 e0 = _mm_add_ps(_mm_set1_ps(edge[0]), _mm_mul_ps(lane, _mm_set1_ps(edgeA[0])));
+        __m128 e1 = _mm_add_ps(_mm_set1_ps(edge[1]), _mm_mul_ps(lane, _mm_set1_ps(edgeA[1])));
+        __m128 e2 = _mm_add_ps(_mm_set1_ps(edge[2]), _mm_mul_ps(lane, _mm_set1_ps(edgeA[2])));
+        __m128 zs = _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(lane, _mm_set1_ps(dzdx)));
+
+        const __m128 e0Step = _mm_set1_ps(edgeA[0] * 4.0f);
+        const __m128 e1Step = _mm_set1_ps(edgeA[1] * 4.0f);
+        const __m128 e2Step = _mm_set1_ps(edgeA[2] * 4.0f);
+        const __m128 zStep = _mm_set1_ps(dzdx * 4.0f);
+
+        for (int x = firstX; x < lastX; x += 4)
+        {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+            if (_mm_movemask_ps(inside))
+            {
+                __m128 current = _mm_load_ps(depth + x);
+                __m128 nearer = _mm_min_ps(current, zs);
+                _mm_store_ps(depth + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+            }
+
+            e0 = _mm_add_ps(e0, e0Step);
+            e1 = _mm_add_ps(e1, e1Step);
+            e2 = _mm_add_ps(e2, e2Step);
+            zs = _mm_add_ps(zs, zStep);
+        }
+#else
+        for (int x = firstX; x < lastX; x++)
+        {
+            if (edge[0] >= 0.0f && edge[1] >= 0.0f && edge[2] >= 0.0f)
+                depth[x] = std::min(depth[x], z);
+
+            edge[0] += edgeA[0];
+            edge[1] += edgeA[1];
+            edge[2] += edgeA[2];
+            z += dzdx;
+        }
+#endif
+    }
+}
+
+void OcclusionBuffer::UpdateTiles(int band)
+{
+    constexpr int TILE_ROWS = BAND_HEIGHT / TILE_SIZE;
+
+    for (int ty = band * TILE_ROWS; ty < (band + 1) * TILE_ROWS; ty++)
+    {
+        for (int tx = 0; tx < TILES_X; tx++)
+        {
+            float farthest = 0.0f;
+            for (int y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; y++)
+            {
+                const float* row = m_Depth + y * WIDTH + tx * TILE_SIZE;
+                for (int x = 0; x < TILE_SIZE; x++)
+                    farthest = std::max(farthest, row[x]);
+            }
+            m_TileMax[ty * TILES_X + tx] = farthest;
+        }
+    }
+}
+
+void OcclusionBuffer::RasterizeBand(int band, uint64_t frame, bool worker)
+{
+    // Frames only grow, so a job left over from an older frame always finds its band claimed
+    uint64_t claimed = m_BandClaimed[band].load();
+    if (claimed >= frame || !m_BandClaimed[band].compare_exchange_strong(claimed, frame))
+        return;
+
+    int minRow = band * BAND_HEIGHT;
+    int maxRow = minRow + BAND_HEIGHT;
+    std::fill(m_Depth + minRow * WIDTH, m_Depth + maxRow * WIDTH, 1.0f);
+
+    for (const Triangle& triangle : m_Triangles)
+    {
+        if (triangle.maxY <= minRow || triangle.minY >= maxRow)
+            continue;
+
+        RasterizeTriangle(triangle, std::max(triangle.minY, minRow), std::min(triangle.maxY, maxRow));
+    }
+
+    UpdateTiles(band);
+
+    if (worker)
+        m_WorkerBands++;
+    m_BandDone[band].store(frame, std::memory_order_release);
+}
+
+void OcclusionBuffer::Finish()
+{
+    for (int band = 0; band < BAND_COUNT; band++)
+    {
+        RasterizeBand(band, m_Frame, false);
+
+        // Claimed by a worker, which is drawing it right now
+        while (m_BandDone[band].load(std::memory_order_acquire) != m_Frame)
+            std::this_thread::yield();
+    }
+}
+
+bool OcclusionBuffer::IsVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+    float minX = (float)WIDTH, maxX = 0.0f;
+    float minY = (float)HEIGHT, maxY = 0.0f;
+    float nearest = 1.0f;
+
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner(
+            (i & 1) ? boxMax.x : boxMin.x,
+            (i & 2) ? boxMax.y : boxMin.y,
+            (i & 4) ? boxMax.z : boxMin.z);
+
+        glm::vec4 clip = m_ViewProjection * glm::vec4(corner, 1.0f);
+        if (clip.z < -clip.w || clip.w <= 1e-5f)
+            return true;
+
+        float invW = 1.0f / clip.w;
+        float x = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+        float y = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, clip.z * invW);
+    }
+
+    // One pixel more on each side, the occluders cover every pixel whose center they touch
+    int x0 = std::max((int)std::floor(std::max(minX, -1.0f)) - 1, 0);
+    int x1 = std::min((int)std::ceil(std::min(maxX, (float)WIDTH + 1.0f)) + 1, WIDTH);
+    int y0 = std::max((int)std::floor(std::max(minY, -1.0f)) - 1, 0);
+    int y1 = std::min((int)std::ceil(std::min(maxY, (float)HEIGHT + 1.0f)) + 1, HEIGHT);
+
+    // Off screen, thats for the frustum test to decide
+    if (x0 >= x1 || y0 >= y1)
+        return true;
+
+    for (int ty = y0 / TILE_SIZE; ty <= (y1 - 1) / TILE_SIZE; ty++)
+    {
+        for (int tx = x0 / TILE_SIZE; tx <= (x1 - 1) / TILE_SIZE; tx++)
+        {
+            // Every pixel of the tile is in front of the box
+            if (m_TileMax[ty * TILES_X + tx] < nearest)
+                continue;
+
+            int rowEnd = std::min(y1, (ty + 1) * TILE_SIZE);
+            int columnEnd = std::min(x1, (tx + 1) * TILE_SIZE);
+            for (int y = std::max(y0, ty * TILE_SIZE); y < rowEnd; y++)
+            {
+                for (int x = std::max(x0, tx * TILE_SIZE); x < columnEnd; x++)
+                {
+                    if (m_Depth[y * WIDTH + x] >= nearest)
+                        return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+void OcclusionBuffer::GetDebugImage(std::vector<uint32_t>& pixels, float maxDistance) const
+{
+    pixels.resize((size_t)WIDTH * HEIGHT);
+
+    // Back from NDC z to the distance along the view direction, z = -P[2][2] - P[3][2] / viewZ
+    float a = m_Projection[2][2];
+    float b = m_Projection[3][2];
+
+    for (int y = 0; y < HEIGHT; y++)
+    {
+        const float* row = m_Depth + y * WIDTH;
+        uint32_t* out = pixels.data() + (size_t)(HEIGHT - 1 - y) * WIDTH;
+
+        for (int x = 0; x < WIDTH; x++)
+        {
+            if (row[x] >= 1.0f)
+            {
+                out[x] = 0xFF401808;
+                continue;
+            }
+
+            float distance = b / (row[x] + a);
+            uint32_t gray = (uint32_t)(255.0f * (1.0f - std::clamp(distance / maxDistance, 0.0f, 1.0f)));
+            out[x] = 0xFF000000 | (gray << 16) | (gray << 8) | gray;
+        }
+    }
+}
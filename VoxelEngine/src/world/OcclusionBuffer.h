@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <glm.hpp>
+
+#include "../CameraFrustum.h"
+
+/*
+* Small depth buffer rasterized on the CPU from a few big occluders, the solid ground of the chunks around the camera.
+* Boxes of distant chunks are tested against it, a box whose nearest point is behind the occluders at every pixel it covers is hidden.
+* That catches chunks behind hills, which SectionOcclusion cant since there is always air above the terrain to walk through.
+*
+* Depth is NDC z like in the real depth buffer, 1 is far. Only the front faces of the occluder boxes are drawn,
+* clipped against the near plane and split into triangles in AddOccluder.
+*
+* The buffer is drawn in BAND_COUNT horizontal bands that dont share any pixels, so every band can be its own job.
+* A band is claimed by whoever gets to it first, Finish rasterizes the ones no worker picked up and waits for the rest.
+* The main thread never waits on jobs that havent started yet, only on bands that are already being drawn.
+*/
+class OcclusionBuffer
+{
+public:
+	static constexpr int WIDTH = 256;
+	static constexpr int HEIGHT = 128;
+	static constexpr int BAND_COUNT = 4;
+	static constexpr int BAND_HEIGHT = HEIGHT / BAND_COUNT;
+
+	// Each tile keeps the farthest depth of its pixels, a box behind that is hidden in the whole tile
+	static constexpr int TILE_SIZE = 8;
+	static constexpr int TILES_X = WIDTH / TILE_SIZE;
+	static constexpr int TILES_Y = HEIGHT / TILE_SIZE;
+
+	static_assert(WIDTH % 4 == 0 && BAND_HEIGHT % TILE_SIZE == 0);
+
+	OcclusionBuffer();
+
+	struct Stats {
+		int occluders = 0;
+		int triangles = 0;
+		int workerBands = 0;	// Bands rasterized by a worker instead of the main thread
+	};
+
+	// Starts a new frame, main thread only. Returns the frame the band jobs have to pass to RasterizeBand.
+	uint64_t Begin(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition);
+
+	// The box has to be completely opaque.
+	// sideBottom can raise the bottom of the side faces (-X, +X, -Z, +Z), where a neighboring occluder already covers them.
+	void AddOccluder(const glm::vec3& boxMin, const glm::vec3& boxMax, const float* sideBottom = nullptr);
+
+	// Draws the band, unless it was already claimed. Any thread, between the last AddOccluder and Finish of the frame.
+	void RasterizeBand(int band, uint64_t frame, bool worker);
+
+	// Draws the bands no worker claimed and waits for the others, main thread only
+	void Finish();
+
+	// False if the box is hidden behind the occluders. Boxes crossing the near plane are always visible.
+	bool IsVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+	Stats GetStats() const { return { m_Stats.occluders, m_Stats.triangles, m_WorkerBands.load() }; }
+
+	// Depth as gray, white is near and black maxDistance or further. Pixels no occluder covers are dark blue.
+	// Rows go top to bottom, RGBA8 for a GL texture.
+	void GetDebugImage(std::vector<uint32_t>& pixels, float maxDistance) const;
+
+private:
+	struct Triangle {
+		glm::vec3 v[3];	// Screen x, y in pixels and NDC z
+		int minY = 0;	// Rows it covers, maxY excluded
+		int maxY = 0;
+	};
+
+	alignas(16) float m_Depth[WIDTH * HEIGHT];
+	float m_TileMax[TILES_X * TILES_Y];
+
+	glm::mat4 m_Projection{ 1.0f };
+	glm::mat4 m_ViewProjection{ 1.0f };
+	glm::vec3 m_CameraPosition{ 0.0f };
+
+	std::vector<Triangle> m_Triangles;
+	Stats m_Stats;
+
+	uint64_t m_Frame = 0;
+	std::atomic<uint64_t> m_BandClaimed[BAND_COUNT] = {};	// Last frame each band was claimed for
+	std::atomic<uint64_t> m_BandDone[BAND_COUNT] = {};
+	std::atomic<int> m_WorkerBands{ 0 };
+
+	void AddPolygon(const glm::vec4* clip, int count);
+	void RasterizeTriangle(const Triangle& triangle, int minRow, int maxRow);
+	void UpdateTiles(int band);
+};
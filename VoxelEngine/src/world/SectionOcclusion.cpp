@@ -0,0 +1,130 @@
+#include "SectionOcclusion.h"
+
+#include "Chunk.h"
+#include "ChunkGrid.h"
+
+#include <cmath>
+
+// Indexed by Chunk::Face, in chunk x, section y, chunk z
+static const glm::ivec3 FACE_DIRECTIONS[Chunk::FACE_COUNT] = {
+    { 0, 0, 1 }, { 0, 0, -1 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }
+};
+
+bool SectionOcclusion::Reach(Chunk& chunk, int section, const Camera& camera)
+{
+    Chunk::OcclusionState& state = chunk.GetOcclusionState();
+
+    // First time this pass, test the whole column once and only look at single sections if it crosses the frustum
+    if (state.pass != m_Pass)
+    {
+        glm::ivec2 coord = chunk.GetChunkPosition();
+        glm::vec3 columnMin((float)coord.x * Chunk::WIDTH - 0.5f, -0.5f, (float)coord.y * Chunk::WIDTH - 0.5f);
+        glm::vec3 columnMax = columnMin + glm::vec3((float)Chunk::WIDTH, (float)Chunk::HEIGHT, (float)Chunk::WIDTH);
+
+        state = { m_Pass, 0, 0 };
+
+        int result = camera.FrustumTestAABB(columnMin, columnMax);
+        if (result == CameraFrustum::INSIDE)
+        {
+            state.inFrustum = (uint8_t)Chunk::ALL_SECTIONS;
+        }
+        else if (result == CameraFrustum::INTERSECT)
+        {
+            for (int i = 0; i < Chunk::SECTION_COUNT; i++)
+            {
+                glm::vec3 sectionMin = columnMin + glm::vec3(0.0f, (float)(i * Chunk::SECTION_SIZE), 0.0f);
+                glm::vec3 sectionMax = glm::vec3(columnMax.x, sectionMin.y + Chunk::SECTION_SIZE, columnMax.z);
+                if (camera.FrustumIntersectsAABB(sectionMin, sectionMax))
+                    state.inFrustum |= 1 << i;
+            }
+        }
+    }
+
+    uint8_t bit = (uint8_t)(1 << section);
+    if (!(state.inFrustum & bit) || (state.reached & bit))
+        return false;
+
+    state.reached |= bit;
+    m_Stats.visitedSections++;
+    return true;
+}
+
+uint8_t SectionOcclusion::GetReachedSections(Chunk& chunk) const
+{
+    const Chunk::OcclusionState& state = chunk.GetOcclusionState();
+    return state.pass == m_Pass ? state.reached : 0;
+}
+
+bool SectionOcclusion::Run(const ChunkGrid& grid, const Camera& camera)
+{
+    // 0 is what new chunks start with
+    if (++m_Pass == 0)
+        m_Pass = 1;
+
+    m_Stats = Stats();
+    m_Queue.clear();
+
+    // Blocks are centered on their coordinate
+    glm::vec3 position = camera.GetPosition() + 0.5f;
+    glm::ivec3 start(
+        (int)std::floor(position.x / Chunk::WIDTH),
+        (int)std::floor(position.y / Chunk::SECTION_SIZE),
+        (int)std::floor(position.z / Chunk::WIDTH));
+
+    if (start.y >= 0 && start.y < Chunk::SECTION_COUNT)
+    {
+        Chunk* chunk = grid.Get({ start.x, start.z });
+        if (!chunk)
+            return false;
+
+        // The camera section is always visible and may be left through any face
+        Chunk::OcclusionState& state = chunk->GetOcclusionState();
+        Reach(*chunk, start.y, camera);
+        state.reached |= 1 << start.y;
+
+        m_Queue.push_back({ chunk, start, NO_FACE, 0 });
+    }
+    else
+    {
+        // Above or below the world, every column is entered through its top or bottom section
+        int section = start.y < 0 ? 0 : Chunk::SECTION_COUNT - 1;
+        uint8_t entryFace = start.y < 0 ? Chunk::FACE_BOTTOM : Chunk::FACE_TOP;
+
+        grid.ForEach([&](const std::shared_ptr<Chunk>& chunk) {
+            if (!Reach(*chunk, section, camera))
+                return;
+
+            glm::ivec2 coord = chunk->GetChunkPosition();
+            m_Queue.push_back({ chunk.get(), { coord.x, section, coord.y }, entryFace, (uint8_t)(1 << (entryFace ^ 1)) });
+        });
+    }
+
+    // Breadth first, the queue only grows while we walk it
+    for (size_t head = 0; head < m_Queue.size(); head++)
+    {
+        Node node = m_Queue[head];
+        SectionVisibility visibility = node.chunk->GetSectionVisibility(node.section.y);
+
+        for (int face = 0; face < Chunk::FACE_COUNT; face++)
+        {
+            // Moving back towards where we came from can only reach sections that are seen through others
+            if ((node.directions >> (face ^ 1)) & 1)
+                continue;
+
+            if (node.entryFace != NO_FACE && !visibility.Connected(node.entryFace, face))
+                continue;
+
+            glm::ivec3 next = node.section + FACE_DIRECTIONS[face];
+            if (next.y < 0 || next.y >= Chunk::SECTION_COUNT)
+                continue;
+
+            Chunk* chunk = FACE_DIRECTIONS[face].y != 0 ? node.chunk : grid.Get({ next.x, next.z });
+            if (!chunk || !Reach(*chunk, next.y, camera))
+                continue;
+
+            m_Queue.push_back({ chunk, next, (uint8_t)(face ^ 1), (uint8_t)(node.directions | (1 << face)) });
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm.hpp>
+
+#include "../Camera.h"
+
+class Chunk;
+class ChunkGrid;
+
+/*
+* Occlusion culling over the chunk sections, CPU only.
+* Starting at the section of the camera it walks to neighboring sections, but only through faces the section it came from
+* connects to the face it entered through (see SectionVisibility), and never back against a direction it already moved in.
+* Sections outside the frustum stop the walk. Whatever wasnt reached is hidden behind terrain, like caves under the camera
+* or the back side of a mountain.
+*
+* Results are stored in Chunk::OcclusionState, tagged with the pass so they dont have to be cleared.
+*/
+class SectionOcclusion
+{
+public:
+	struct Stats {
+		int visitedSections = 0;
+	};
+
+	// Returns false if the camera is in a chunk that isnt loaded, the walk has nowhere to start then and nothing was marked
+	bool Run(const ChunkGrid& grid, const Camera& camera);
+
+	// Sections of the chunk the last Run reached, one bit per section
+	uint8_t GetReachedSections(Chunk& chunk) const;
+
+	Stats GetStats() const { return m_Stats; }
+
+private:
+	static constexpr uint8_t NO_FACE = 0xFF;
+
+	struct Node {
+		Chunk* chunk;
+		glm::ivec3 section;		// Chunk x, section y, chunk z
+		uint8_t entryFace;		// Face of this section the walk came in through
+		uint8_t directions;		// Directions moved so far, one bit per Chunk::Face
+	};
+
+	uint32_t m_Pass = 0;
+	std::vector<Node> m_Queue;
+	Stats m_Stats;
+
+	// Marks the section as reached, false if it already was or isnt in the frustum
+	bool Reach(Chunk& chunk, int section, const Camera& camera);
+};
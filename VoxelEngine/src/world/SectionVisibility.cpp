@@ -0,0 +1,104 @@
+#include "SectionVisibility.h"
+
+#include "Chunk.h"
+
+static_assert(SectionVisibility::SIZE == Chunk::SECTION_SIZE && SectionVisibility::SIZE == Chunk::WIDTH);
+static_assert(SectionVisibility::FACE_COUNT == Chunk::FACE_COUNT);
+static_assert(SectionVisibility::PairBit(4, 5) == 14);
+
+void SectionVisibility::ConnectFaces(uint8_t faces)
+{
+    for (int a = 0; a < FACE_COUNT; a++)
+    {
+        if (!((faces >> a) & 1))
+            continue;
+
+        for (int b = a + 1; b < FACE_COUNT; b++)
+        {
+            if ((faces >> b) & 1)
+                bits |= 1 << PairBit(a, b);
+        }
+    }
+}
+
+namespace
+{
+    constexpr int VOLUME = SectionVisibility::SIZE * SectionVisibility::SIZE * SectionVisibility::SIZE;
+
+    // Faces of the section the block touches
+    uint8_t BorderFaces(int x, int y, int z)
+    {
+        constexpr int MAX = SectionVisibility::SIZE - 1;
+
+        uint8_t faces = 0;
+        if (z == MAX) faces |= 1 << Chunk::FACE_FRONT;
+        if (z == 0) faces |= 1 << Chunk::FACE_BACK;
+        if (x == 0) faces |= 1 << Chunk::FACE_LEFT;
+        if (x == MAX) faces |= 1 << Chunk::FACE_RIGHT;
+        if (y == MAX) faces |= 1 << Chunk::FACE_TOP;
+        if (y == 0) faces |= 1 << Chunk::FACE_BOTTOM;
+        return faces;
+    }
+}
+
+SectionVisibility SectionVisibility::Compute(const uint8_t* opaque)
+{
+    SectionVisibility visibility = Closed();
+
+    uint8_t visited[VOLUME] = {};
+    uint16_t stack[VOLUME];
+
+    // Regions that dont touch the border cant connect anything, so only border blocks start a fill
+    for (int y = 0; y < SIZE; y++)
+    {
+        for (int z = 0; z < SIZE; z++)
+        {
+            for (int x = 0; x < SIZE; x++)
+            {
+                int start = (y * SIZE + z) * SIZE + x;
+                if (opaque[start] || visited[start] || !BorderFaces(x, y, z))
+                    continue;
+
+                uint8_t faces = 0;
+                int top = 0;
+                stack[top++] = (uint16_t)start;
+                visited[start] = 1;
+
+                while (top > 0)
+                {
+                    int index = stack[--top];
+                    int bx = index % SIZE;
+                    int bz = (index / SIZE) % SIZE;
+                    int by = index / (SIZE * SIZE);
+
+                    faces |= BorderFaces(bx, by, bz);
+
+                    auto visit = [&](int nx, int ny, int nz) {
+                        if (nx < 0 || nx >= SIZE || ny < 0 || ny >= SIZE || nz < 0 || nz >= SIZE)
+                            return;
+
+                        int neighbor = (ny * SIZE + nz) * SIZE + nx;
+                        if (opaque[neighbor] || visited[neighbor])
+                            return;
+
+                        visited[neighbor] = 1;
+                        stack[top++] = (uint16_t)neighbor;
+                    };
+
+                    visit(bx - 1, by, bz);
+                    visit(bx + 1, by, bz);
+                    visit(bx, by - 1, bz);
+                    visit(bx, by + 1, bz);
+                    visit(bx, by, bz - 1);
+                    visit(bx, by, bz + 1);
+                }
+
+                visibility.ConnectFaces(faces);
+                if (visibility.bits == ALL)
+                    return visibility;
+            }
+        }
+    }
+
+    return visibility;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+* Which faces of a 16x16x16 chunk section can see each other through the section, one bit per pair of faces (15 pairs).
+* Built by flood filling the blocks that are not opaque, two faces are connected if one filled region touches both.
+* This is Minecraft's chunk visibility graph, SectionOcclusion walks it from the camera to find the sections that can be seen.
+*
+* Faces are numbered like Chunk::Face, the opposite of a face is face ^ 1.
+*/
+struct SectionVisibility
+{
+	static constexpr int SIZE = 16;
+	static constexpr int FACE_COUNT = 6;
+	static constexpr uint16_t ALL = 0x7FFF;
+
+	uint16_t bits = ALL; // Everything is connected until the section is meshed
+
+	static constexpr int PairBit(int a, int b)
+	{
+		if (a > b) { int t = a; a = b; b = t; }
+		return a * (2 * FACE_COUNT - 1 - a) / 2 + (b - a - 1);
+	}
+
+	bool Connected(int a, int b) const { return a == b || ((bits >> PairBit(a, b)) & 1); }
+
+	// Connects every pair of the faces set in the mask
+	void ConnectFaces(uint8_t faces);
+
+	// opaque has one flag per block of the section, indexed (y * SIZE + z) * SIZE + x like ChunkSection
+	static SectionVisibility Compute(const uint8_t* opaque);
+
+	static SectionVisibility Open() { return { ALL }; }
+	static SectionVisibility Closed() { return { 0 }; }
+};
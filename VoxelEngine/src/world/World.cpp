@@ -4,6 +4,8 @@
 #include "../VertexBufferLayout.h"
 
 #include <algorithm>
+#include <bit>
+#include <chrono>
 #include <iostream>
 
 World::World(int seed) :
@@ -39,93 +41,385 @@ World::World(int seed) :
 
 	m_Seed = seed;
 
-	InitThreadPool();
+    // Keep every worker busy, the jobs are independent chunks
+    m_MaxConcurrentGenerations = m_JobSystem.GetThreadCount();
 }
 
 World::~World()
 {
-	ShutdownThreadPool();
+    // Queued jobs still point at our chunks, finish them first
+    m_JobSystem.Shutdown();
 }
 
 Chunk* World::GetChunk(int cx, int cz)
 {
-    std::lock_guard<std::mutex> lock(m_ChunksMutex);
-    glm::ivec2 coord { cx, cz };
-
-    auto it = m_Chunks.find(coord);
-    if (it == m_Chunks.end())
-        return nullptr;
+    return m_ChunkGrid.Get({ cx, cz });
+}
 
-    return it->second.get();
+void World::InsertChunk(glm::ivec2 coord, std::shared_ptr<Chunk> chunk)
+{
+    // Only happens for a chunk far outside the unload distance that hasnt been unloaded yet
+    if (std::shared_ptr<Chunk> displaced = m_ChunkGrid.Insert(coord, std::move(chunk)))
+        ReleaseChunks({ displaced });
 }
 
-Chunk& World::CreateChunk(int cx, int cz)
+void World::ReleaseChunks(const std::vector<std::shared_ptr<Chunk>>& chunks)
 {
-    std::lock_guard<std::mutex> lock(m_ChunksMutex);
-    glm::ivec2 coord { cx, cz };
+    if (chunks.empty())
+        return;
 
-    auto it = m_Chunks.find(coord);
-    if (it != m_Chunks.end())
-        return *it->second;
+    // GL objects can only be deleted here. The chunks are freed once the caller drops them, or later by the last job holding one
+    for (auto& chunk : chunks)
+    {
+        chunk->CancelJobs();
+        chunk->ReleaseGPUResources(m_MeshArena);
+        m_PendingUpdates.erase(chunk->GetChunkPosition());
+    }
 
-    auto chunk = std::make_unique<Chunk>(glm::ivec2(cx, cz));
-    Chunk& ref = *chunk;
+    m_ResidencyStats.unloadedChunks += chunks.size();
+    m_ResidencyStats.loadedChunks = m_ChunkGrid.GetCount();
 
-    m_Chunks.emplace(coord, std::move(chunk));
-    return ref;
+    // The raycast cache might point at one of them
+    raycastChunk = nullptr;
+    lastcx = INT_MIN;
+    lastcz = INT_MIN;
 }
 
-void World::UpdateChunksInRadius(int cx, int cz, int renderDistance)
+void World::UpdateChunksInRadius(const Camera& camera, int renderDistance)
 {
 	// Assume: We have the Camera Position in Chunk Coordinates (cx, cz)
 	// We have the render distance in chunks
 	// We only want to load all chunks in renderDistance around the camera meaning camera +- renderDistance in both directions.
-    // So each frame? check if all chunks in that area exist, if not create and generate them.
 	// For all other chunks just drop them from memory?????
-    // Kinda slow
+    int cx = WorldToChunk(static_cast<int>(camera.GetPosition().x));
+    int cz = WorldToChunk(static_cast<int>(camera.GetPosition().z));
+
+    m_FrameIndex++;
+
+    // The grid has to hold everything up to the unload distance without two chunks sharing a slot
+    ReleaseChunks(m_ChunkGrid.Reserve(renderDistance + std::max(unloadMargin, 1)));
+
+    if (glm::ivec2(cx, cz) != m_WindowCenter || renderDistance != m_WindowRadius)
+        MoveWindow(cx, cz, renderDistance);
+
+    // Missing chunks are generated in priority order. The order only changes when the camera enters another chunk or turns noticeably
+    glm::vec2 forward(camera.GetFront().x, camera.GetFront().z);
+    bool moved = glm::ivec2(cx, cz) != m_GenQueueCenter || renderDistance != m_GenQueueRadius;
+    bool turned = glm::length(forward) > 0.001f && glm::dot(glm::normalize(forward), m_GenQueueForward) < 0.9f;
+    if (moved || turned)
+        RebuildChunkGenQueue(camera, cx, cz, renderDistance);
+
+    while (!m_ChunkGenQueue.empty() && m_ActiveChunkGenerations < m_MaxConcurrentGenerations)
+    {
+        glm::ivec2 coord = m_ChunkGenQueue.top().coord;
+        m_ChunkGenQueue.pop();
+
+        if (!GetChunk(coord.x, coord.y))
+            GenerateChunk(coord.x, coord.y);
+    }
+
+    UpdatePendingChunks();
+
+    // Nothing gets bigger or leaves the window on an idle frame
+    if (m_ResidencyChanged)
+    {
+        UnloadChunks(cx, cz, renderDistance);
+        m_ResidencyChanged = false;
+    }
+}
+
+void World::MoveWindow(int cx, int cz, int renderDistance)
+{
+    glm::ivec2 oldCenter = m_WindowCenter;
+    int oldRadius = m_WindowRadius;
+
+    auto inOldWindow = [&](int x, int z) {
+        return oldRadius >= 0 && std::max(std::abs(x - oldCenter.x), std::abs(z - oldCenter.y)) <= oldRadius;
+    };
+
+    m_WindowCenter = { cx, cz };
+    m_WindowRadius = renderDistance;
+    m_ResidencyChanged = true;
+
+    for (auto it = m_PendingUpdates.begin(); it != m_PendingUpdates.end();)
+    {
+        if (InWindow(*it))
+            ++it;
+        else
+            it = m_PendingUpdates.erase(it);
+    }
+
+    // Chunks that left the window remember when, the oldest ones are unloaded first.
+    // Their mesh jobs are cancelled, and chunks whose terrain isnt done yet are dropped once they are outside the load distance (+1 ring).
+    std::vector<std::shared_ptr<Chunk>> dropped;
+    if (oldRadius >= 0)
+    {
+        int oldLoadDistance = oldRadius + 1;
+        for (int x = oldCenter.x - oldLoadDistance; x <= oldCenter.x + oldLoadDistance; x++)
+        {
+            for (int z = oldCenter.y - oldLoadDistance; z <= oldCenter.y + oldLoadDistance; z++)
+            {
+                if (InWindow({ x, z }))
+                    continue;
+
+                Chunk* chunk = GetChunk(x, z);
+                if (!chunk)
+                    continue;
+
+                if (chunk->GetState() == ChunkState::TERRAIN)
+                {
+                    if (std::max(std::abs(x - cx), std::abs(z - cz)) > renderDistance + 1)
+                        dropped.push_back(m_ChunkGrid.Remove({ x, z }));
+                    continue;
+                }
+
+                chunk->SetLastSeenFrame(m_FrameIndex);
+                chunk->CancelJobs();
+            }
+        }
+    }
+    ReleaseChunks(dropped);
+
+    // Chunks that came back might have been marked dirty while outside (a new neighbor for example)
+    for (int x = cx - renderDistance; x <= cx + renderDistance; x++)
+    {
+        for (int z = cz - renderDistance; z <= cz + renderDistance; z++)
+        {
+            if (inOldWindow(x, z))
+                continue;
+
+            Chunk* chunk = GetChunk(x, z);
+            if (chunk && chunk->IsTerrainGenerated() && chunk->NeedsUpdate())
+                m_PendingUpdates.insert({ x, z });
+        }
+    }
+}
+
+void World::RequestChunkUpdate(glm::ivec2 coord)
+{
+    std::lock_guard<std::mutex> lock(m_UpdateRequestsMutex);
+    m_UpdateRequests.push_back(coord);
+}
+
+void World::UpdatePendingChunks()
+{
+    std::vector<glm::ivec2> requests;
+    {
+        std::lock_guard<std::mutex> lock(m_UpdateRequestsMutex);
+        requests.swap(m_UpdateRequests);
+    }
+
+    // New meshes and chunks change the memory use
+    if (!requests.empty())
+        m_ResidencyChanged = true;
+
+    for (const glm::ivec2& coord : requests)
+    {
+        // Finished terrain jobs ask for an update too, that is when neighborhoods complete
+        Chunk* chunk = GetChunk(coord.x, coord.y);
+        if (chunk && chunk->GetState() == ChunkState::DECORATED)
+            PromoteNeighborhood(coord);
+
+        if (InWindow(coord))
+            m_PendingUpdates.insert(coord);
+    }
+
+    if (m_PendingUpdates.empty())
+        return;
+
+    // Collected first, erasing from the set while updating would invalidate the iteration
+    std::vector<Chunk*> chunks;
+    chunks.reserve(m_PendingUpdates.size());
+    for (auto it = m_PendingUpdates.begin(); it != m_PendingUpdates.end();)
+    {
+        Chunk* chunk = GetChunk(it->x, it->y);
+        if (!chunk || !chunk->IsTerrainGenerated())
+        {
+            // Terrain jobs ask again once the chunk is done
+            it = m_PendingUpdates.erase(it);
+            continue;
+        }
+
+        chunks.push_back(chunk);
+        ++it;
+    }
+
+    // New meshes are uploaded nearest first within the frame budget, everything else is cheap and updates right away
+    std::vector<Chunk*> uploads;
+    for (Chunk* chunk : chunks)
+    {
+        if (chunk->HasNewMesh())
+            uploads.push_back(chunk);
+        else
+            chunk->Update(this);
+    }
+
+    auto distanceToCenter = [this](const Chunk* chunk) {
+        glm::ivec2 offset = chunk->GetChunkPosition() - m_WindowCenter;
+        return offset.x * offset.x + offset.y * offset.y;
+    };
+    std::sort(uploads.begin(), uploads.end(), [&](const Chunk* a, const Chunk* b) {
+        return distanceToCenter(a) < distanceToCenter(b);
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    auto elapsedMs = [&]() {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    m_UploadStats = {};
+    for (Chunk* chunk : uploads)
+    {
+        if (m_UploadStats.uploads > 0 && (elapsedMs() >= uploadBudgetMs || m_UploadStats.bytes >= uploadBudgetBytes))
+        {
+            m_UploadStats.deferred++;
+            continue;
+        }
+
+        m_UploadStats.bytes += chunk->UploadNewMesh(this);
+        m_UploadStats.uploads++;
+
+        // Edits that came in while the mesh waited
+        chunk->Update(this);
+    }
+    m_UploadStats.milliseconds = elapsedMs();
+
+    for (Chunk* chunk : chunks)
+    {
+        if (!chunk->NeedsUpdate())
+            m_PendingUpdates.erase(chunk->GetChunkPosition());
+    }
+}
 
-	for (int i = -renderDistance; i <= renderDistance; i++)
+void World::UnloadChunks(int cx, int cz, int renderDistance)
+{
+    struct Candidate {
+        uint64_t lastSeen;
+        glm::ivec2 coord;
+        size_t bytes;
+    };
+
+    int unloadDistance = renderDistance + std::max(unloadMargin, 1);
+
+    std::vector<glm::ivec2> unload;
+    std::vector<Candidate> candidates;
+    size_t bytes = 0;
+
+    m_ChunkGrid.ForEach([&](const std::shared_ptr<Chunk>& chunk) {
+        glm::ivec2 coord = chunk->GetChunkPosition();
+        int distance = std::max(std::abs(coord.x - cx), std::abs(coord.y - cz));
+        if (distance > unloadDistance)
+        {
+            unload.push_back(coord);
+            return;
+        }
+
+        // Chunks that are still generating belong to their job, we only look at their blocks afterwards
+        if (chunk->IsTerrainGenerated())
+        {
+            size_t chunkBytes = chunk->GetMemoryUsage();
+            bytes += chunkBytes;
+
+            // Chunks inside the render distance, or the ring their neighbors need, would just be generated again right away
+            if (distance > renderDistance + 1)
+                candidates.push_back({ chunk->GetLastSeenFrame(), coord, chunkBytes });
+        }
+    });
+
+    if (memoryBudget > 0 && bytes > memoryBudget)
     {
-        for (int j = -renderDistance; j <= renderDistance; j++)
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return a.lastSeen < b.lastSeen;
+        });
+
+        for (const Candidate& candidate : candidates)
+        {
+            if (bytes <= memoryBudget)
+                break;
+
+            unload.push_back(candidate.coord);
+            bytes -= candidate.bytes;
+        }
+    }
+
+    std::vector<std::shared_ptr<Chunk>> unloaded;
+    unloaded.reserve(unload.size());
+    for (const glm::ivec2& coord : unload)
+        unloaded.push_back(m_ChunkGrid.Remove(coord));
+
+    m_ResidencyStats.bytes = bytes;
+    m_ResidencyStats.loadedChunks = m_ChunkGrid.GetCount();
+    ReleaseChunks(unloaded);
+}
+
+void World::RebuildChunkGenQueue(const Camera& camera, int cx, int cz, int renderDistance)
+{
+    m_GenQueueCenter = { cx, cz };
+    glm::vec2 forward(camera.GetFront().x, camera.GetFront().z);
+    if (glm::length(forward) > 0.001f)
+        m_GenQueueForward = glm::normalize(forward);
+    m_GenQueueRadius = renderDistance;
+
+    // One ring more than the render distance, the outermost chunks we draw need their neighbors before they are meshed
+    int loadDistance = renderDistance + 1;
+
+    std::vector<ChunkLoadRequest> requests;
+    requests.reserve((2 * loadDistance + 1) * (2 * loadDistance + 1));
+
+    for (int i = -loadDistance; i <= loadDistance; i++)
+    {
+        for (int j = -loadDistance; j <= loadDistance; j++)
         {
             int chunkX = cx + i;
             int chunkZ = cz + j;
+            if (GetChunk(chunkX, chunkZ))
+                continue;
 
-            Chunk* chunk = GetChunk(chunkX, chunkZ);
+            // Nearest first. Chunks outside the view still load, but after visible ones a few times as far away,
+            // the ring right around the camera is still needed quickly when turning around
+            float priority = std::sqrt((float)(i * i + j * j));
 
+            glm::vec3 boxMin((float)chunkX * Chunk::WIDTH, 0.0f, (float)chunkZ * Chunk::WIDTH);
+            glm::vec3 boxMax = boxMin + glm::vec3((float)Chunk::WIDTH, (float)Chunk::HEIGHT, (float)Chunk::WIDTH);
+            if (!camera.FrustumIntersectsAABB(boxMin, boxMax))
+                priority *= 3.0f;
 
-            if (!chunk)
-            {
-                GenerateChunk(chunkX, chunkZ);
-            }
-            else if (chunk->IsTerrainGenerated()) {
-				// Only update chunks when dirty
-				chunk->Update(this);
-            }
+            requests.push_back({ priority, { chunkX, chunkZ } });
         }
     }
+
+    m_ChunkGenQueue = decltype(m_ChunkGenQueue)(std::greater<ChunkLoadRequest>(), std::move(requests));
 }
 
 void World::GenerateChunk(int cx, int cz) {
-    if (m_ActiveChunkGenerations >= MAX_CONCURRENT_GENERATIONS) {
+    if (m_ActiveChunkGenerations >= m_MaxConcurrentGenerations) {
         return; // Skip if too many chunks are generating
     }
 
     m_ActiveChunkGenerations++;
     auto chunkPtr = std::make_shared<Chunk>(glm::ivec2(cx, cz));
-    
-    {
-        std::lock_guard<std::mutex> lock(m_ChunksMutex);
-        m_Chunks[glm::ivec2(cx, cz)] = chunkPtr;
-    }
+    InsertChunk({ cx, cz }, chunkPtr);
 
-    EnqueueJob([this, cx, cz, chunkPtr]() {
+    EnqueueJob([this, cx, cz, chunkPtr, epoch = chunkPtr->GetJobEpoch()]() {
         constexpr int CHUNK_SIZE = 16;
         constexpr int CHUNK_HEIGHT = 128;
         constexpr int SEA_LEVEL = 62;
         constexpr int MIN_HEIGHT = 45;
         constexpr int MAX_HEIGHT = 95;
 
+        // The chunk got dropped (camera moved away) before or while we ran, stop between passes
+        auto cancelled = [&]() {
+            if (chunkPtr->IsJobCurrent(epoch))
+                return false;
+
+            CountCancelledJob(true);
+            m_ActiveChunkGenerations--;
+            return true;
+        };
+
+        if (cancelled())
+            return;
+
         int heightMap[CHUNK_SIZE][CHUNK_SIZE];
 
         // HEIGHT PASS
@@ -153,6 +447,9 @@ void World::GenerateChunk(int cx, int cz) {
             }
         }
 
+        if (cancelled())
+            return;
+
         // BLOCK PASS
         for (int x = 0; x < CHUNK_SIZE; x++) {
             for (int z = 0; z < CHUNK_SIZE; z++) {
@@ -190,6 +487,9 @@ void World::GenerateChunk(int cx, int cz) {
             }
         }
 
+        if (cancelled())
+            return;
+
         // TREE PASS
         for (int x = 0; x < CHUNK_SIZE; x++) {
             for (int z = 0; z < CHUNK_SIZE; z++) {
@@ -220,11 +520,14 @@ void World::GenerateChunk(int cx, int cz) {
             }
         }
 
-        chunkPtr->SetTerrainGenerated(true);
+        // Trees and terrain might leave unused palette entries behind
+        chunkPtr->CompactBlocks();
+
         chunkPtr->SetIsFullyLoaded(true);
-        chunkPtr->SetIsDirty(true);
+        chunkPtr->SetState(ChunkState::DECORATED);
 
-        NotifyNeighborsOfNewChunk(cx, cz);
+        // Meshing waits until the neighbors are there too, the main thread checks that
+        RequestChunkUpdate({ cx, cz });
 
         m_ActiveChunkGenerations--;
         });
@@ -287,39 +590,71 @@ void World::GenerateTree(std::shared_ptr<Chunk> chunk, int x, int y, int z, int
     }
 }
 
-void World::NotifyNeighborsOfNewChunk(int cx, int cz) {
-	// Mark all 4 Neighbors as dirty so they update and re render the faces towards this new chunk
-    Chunk* leftN = GetChunk(cx - 1, cz);
-    Chunk* rightN = GetChunk(cx + 1, cz);
-    Chunk* backN = GetChunk(cx, cz - 1);
-    Chunk* frontN = GetChunk(cx, cz + 1);
+void World::PromoteNeighborhood(glm::ivec2 coord)
+{
+    // A new chunk can complete its own neighborhood and the one of every neighbor
+    TryPromote(coord);
+    TryPromote({ coord.x - 1, coord.y });
+    TryPromote({ coord.x + 1, coord.y });
+    TryPromote({ coord.x, coord.y - 1 });
+    TryPromote({ coord.x, coord.y + 1 });
+}
+
+void World::TryPromote(glm::ivec2 coord)
+{
+    Chunk* chunk = GetChunk(coord.x, coord.y);
+    if (!chunk || chunk->GetState() != ChunkState::DECORATED)
+        return;
 
-    if (leftN && leftN->GetIsFullyLoaded() && leftN->IsTerrainGenerated()) {
-        leftN->SetIsDirty(true);
-    }
-    if (rightN && rightN->GetIsFullyLoaded() && rightN->IsTerrainGenerated()) {
-        rightN->SetIsDirty(true);
-    }
-    if (backN && backN->GetIsFullyLoaded() && backN->IsTerrainGenerated()) {
-        backN->SetIsDirty(true);
-    }
-    if (frontN && frontN->GetIsFullyLoaded() && frontN->IsTerrainGenerated()) {
-        frontN->SetIsDirty(true);
-    }
+    auto decorated = [this](int cx, int cz) {
+        Chunk* neighbor = GetChunk(cx, cz);
+        return neighbor && neighbor->IsTerrainGenerated();
+    };
+
+    if (!decorated(coord.x - 1, coord.y) || !decorated(coord.x + 1, coord.y) ||
+        !decorated(coord.x, coord.y - 1) || !decorated(coord.x, coord.y + 1))
+        return;
+
+    chunk->SetState(ChunkState::READY);
+    chunk->SetIsDirty(true);
+
+    if (InWindow(coord))
+        m_PendingUpdates.insert(coord);
 }
 
-void World::MarkChunkDirty(int cx, int cz) {
-    Chunk* chunk = GetChunk(cx, cz);
-    if (chunk && chunk->GetIsFullyLoaded()) {
-        chunk->SetIsDirty(true);;
-    }
+void World::RemeshAllChunks()
+{
+    std::vector<glm::ivec2> coords;
+    m_ChunkGrid.ForEach([&](const std::shared_ptr<Chunk>& chunk) {
+        // Chunks that arent READY yet get their first mesh with the new settings anyway
+        if (chunk->GetState() >= ChunkState::READY)
+        {
+            chunk->SetIsDirty(true);
+            coords.push_back(chunk->GetChunkPosition());
+        }
+    });
+
+    std::lock_guard<std::mutex> lock(m_UpdateRequestsMutex);
+    m_UpdateRequests.insert(m_UpdateRequests.end(), coords.begin(), coords.end());
+}
+
+World::MeshStats World::GetMeshStats()
+{
+    MeshStats stats;
+    m_ChunkGrid.ForEach([&](const std::shared_ptr<Chunk>& chunk) {
+        stats.solidVertices += chunk->GetSolidVertexCount();
+        stats.waterVertices += chunk->GetWaterVertexCount();
+        stats.meshJobs += chunk->GetMeshJobCount();
+        if (chunk->GetState() == ChunkState::MESHED)
+            stats.meshedChunks++;
+    });
+    return stats;
 }
 
 void World::DropChunk(int cx, int cz)
 {
-    std::lock_guard<std::mutex> lock(m_ChunksMutex);
-    glm::ivec2 coord { cx, cz };
-	m_Chunks.erase(coord);
+    if (std::shared_ptr<Chunk> chunk = m_ChunkGrid.Remove({ cx, cz }))
+        ReleaseChunks({ chunk });
 }
 
 BlockType World::GetBlock(int wx, int wy, int wz)
@@ -327,8 +662,9 @@ BlockType World::GetBlock(int wx, int wy, int wz)
     int cx = WorldToChunk(wx);
     int cz = WorldToChunk(wz);
 
+    // Until its terrain is done a worker is still writing the sections
     Chunk* chunk = GetChunk(cx, cz);
-    if (!chunk) return BlockType::AIR;
+    if (!chunk || !chunk->IsTerrainGenerated()) return BlockType::AIR;
 
     return chunk->GetBlockType(
         WorldToLocal(wx),
@@ -342,41 +678,271 @@ void World::SetBlock(int wx, int wy, int wz, BlockType type)
     int cx = WorldToChunk(wx);
     int cz = WorldToChunk(wz);
 
-    Chunk& chunk = CreateChunk(cx, cz);
+    // Edits to chunks that arent there or still generating are dropped, the generation job owns their blocks.
+    // A chunk created here would never be generated either, the generation queue skips loaded chunks.
+    Chunk* chunk = GetChunk(cx, cz);
+    if (!chunk || !chunk->IsTerrainGenerated())
+        return;
 
-    chunk.SetBlock(
-        WorldToLocal(wx),
-        wy,
-        WorldToLocal(wz),
-        type
-    );
+    int lx = WorldToLocal(wx);
+    int lz = WorldToLocal(wz);
+
+    chunk->SetBlock(lx, wy, lz, type);
+    RequestChunkUpdate({ cx, cz });
+
+    // Blocks on the chunk border are also part of the neighbors mesh
+    if (wy >= 0 && wy < Chunk::HEIGHT)
+    {
+        int section = wy / Chunk::SECTION_SIZE;
+        auto markNeighbor = [&](int ncx, int ncz) {
+            if (Chunk* neighbor = GetChunk(ncx, ncz))
+            {
+                neighbor->MarkSectionDirty(section);
+                RequestChunkUpdate({ ncx, ncz });
+            }
+        };
+
+        if (lx == 0) markNeighbor(cx - 1, cz);
+        if (lx == Chunk::WIDTH - 1) markNeighbor(cx + 1, cz);
+        if (lz == 0) markNeighbor(cx, cz - 1);
+        if (lz == Chunk::WIDTH - 1) markNeighbor(cx, cz + 1);
+    }
 }
 
-void World::Render(Renderer& renderer, Shader& shader, Camera& camera, int layer)
+void World::BeginOcclusionBuffer(const Camera& camera, const glm::mat4& projection)
 {
-    for (auto& [coord, chunk] : m_Chunks)
+    uint64_t frame = m_OcclusionBuffer.Begin(projection, camera.GetViewMatrix(), camera.GetPosition());
+
+    glm::ivec2 center(WorldToChunk((int)std::floor(camera.GetPosition().x + 0.5f)), WorldToChunk((int)std::floor(camera.GetPosition().z + 0.5f)));
+
+    // Heights of all quadrants in range first, so side faces covered by a neighbor can be left out.
+    // Most of the terrain is one big solid block and without that almost every pixel would be drawn by many faces.
+    int chunks = occluderDistance * 2 + 1;
+    int size = chunks * 2;
+    glm::ivec2 first = (center - occluderDistance) * 2;
+    m_OccluderHeights.assign((size_t)size * size, 0);
+
+    for (int z = 0; z < chunks; z++)
     {
-        if (!chunk || !chunk->GetIsFullyLoaded() || !chunk->IsTerrainGenerated())
-            continue;
+        for (int x = 0; x < chunks; x++)
+        {
+            Chunk* chunk = m_ChunkGrid.Get({ center.x - occluderDistance + x, center.y - occluderDistance + z });
+            if (!chunk || !chunk->GetIsFullyLoaded())
+                continue;
+
+            const Chunk::OccluderHeights& heights = chunk->GetOccluderHeights();
+            for (int quadrant = 0; quadrant < 4; quadrant++)
+                m_OccluderHeights[(z * 2 + (quadrant >> 1)) * size + x * 2 + (quadrant & 1)] = heights[quadrant];
+        }
+    }
+
+    auto heightAt = [&](int x, int z) -> int {
+        return x >= 0 && x < size && z >= 0 && z < size ? m_OccluderHeights[z * size + x] : 0;
+    };
 
-        if (frustumCulling)
+    // From inside an occluder (underground) it doesnt cover the faces of its neighbors
+    glm::vec3 position = camera.GetPosition() + 0.5f;
+    glm::ivec2 cameraQuadrant = glm::ivec2(glm::floor(glm::vec2(position.x, position.z) / (float)Chunk::QUADRANT_SIZE)) - first;
+    auto coverAt = [&](int x, int z) -> int {
+        int height = heightAt(x, z);
+        return x == cameraQuadrant.x && z == cameraQuadrant.y && position.y < height ? 0 : height;
+    };
+
+    for (int z = 0; z < size; z++)
+    {
+        for (int x = 0; x < size; x++)
         {
-            float minX = (float)coord.x * Chunk::WIDTH;
-            float minZ = (float)coord.y * Chunk::WIDTH;
-            float maxX = minX + Chunk::WIDTH;
-            float maxZ = minZ + Chunk::WIDTH;
+            int height = heightAt(x, z);
+            if (height == 0)
+                continue;
+
+            // Block corners, blocks are centered on their coordinate
+            glm::vec3 boxMin((float)((first.x + x) * Chunk::QUADRANT_SIZE) - 0.5f, -0.5f, (float)((first.y + z) * Chunk::QUADRANT_SIZE) - 0.5f);
+            glm::vec3 boxMax = boxMin + glm::vec3((float)Chunk::QUADRANT_SIZE, (float)height, (float)Chunk::QUADRANT_SIZE);
+
+            if (!camera.FrustumIntersectsAABB(boxMin, boxMax))
+                continue;
+
+            int neighbors[4] = { coverAt(x - 1, z), coverAt(x + 1, z), coverAt(x, z - 1), coverAt(x, z + 1) };
+            float sideBottom[4];
+            for (int side = 0; side < 4; side++)
+                sideBottom[side] = (float)std::min(neighbors[side], height) - 0.5f;
+
+            m_OcclusionBuffer.AddOccluder(boxMin, boxMax, sideBottom);
+        }
+    }
+
+    // The main thread joins in once it is done with the rest of the culling, whatever is left by then it draws itself
+    for (int band = 0; band < OcclusionBuffer::BAND_COUNT; band++)
+    {
+        OcclusionBuffer* buffer = &m_OcclusionBuffer;
+        EnqueueJob([buffer, band, frame]() { buffer->RasterizeBand(band, frame, true); });
+    }
+}
+
+void World::CullChunks(const Camera& camera, const glm::mat4& projection)
+{
+    m_VisibleChunks.clear();
+    m_FrustumChunks.clear();
+    m_DrawCommands.clear();
+    m_CullStats = CullStats();
+
+    // First, so the workers draw the occlusion buffer while we cull
+    if (depthOcclusionCulling)
+        BeginOcclusionBuffer(camera, projection);
 
-            // AABB check
-            if (!camera.FrustumIntersectsAABB(glm::vec3(minX, 0.0f, minZ), glm::vec3(maxX, (float)Chunk::HEIGHT, maxZ)))
+    m_ChunkCuller.Begin(m_ChunkGrid.GetSize());
+
+    m_ChunkGrid.ForEach([&](const std::shared_ptr<Chunk>& chunk) {
+        if (!chunk->GetIsFullyLoaded() || !chunk->IsTerrainGenerated())
+            return;
+
+        glm::ivec2 coord = chunk->GetChunkPosition();
+        glm::vec3 boxMin, boxMax;
+        if (tightChunkBounds)
+        {
+            // Only around the geometry the mesher emitted, chunks without any have nothing to draw
+            if (!chunk->GetMeshBounds(boxMin, boxMax))
             {
+                m_CullStats.empty++;
+                return;
+            }
+        }
+        else
+        {
+            boxMin = glm::vec3((float)coord.x * Chunk::WIDTH, 0.0f, (float)coord.y * Chunk::WIDTH);
+            boxMax = boxMin + glm::vec3((float)Chunk::WIDTH, (float)Chunk::HEIGHT, (float)Chunk::WIDTH);
+        }
+
+        m_ChunkCuller.Add(chunk.get(), coord, boxMin, boxMax);
+    });
+
+    m_CullStats.candidates = (int)m_ChunkCuller.GetChunks().size();
+
+    if (frustumCulling)
+    {
+        m_ChunkCuller.Cull(camera, hierarchicalCulling, m_FrustumChunks);
+
+        ChunkCuller::Stats stats = m_ChunkCuller.GetStats();
+        m_CullStats.regionTests = stats.regionTests;
+        m_CullStats.chunkTests = stats.chunkTests;
+        m_CullStats.inside = stats.inside;
+    }
+    else
+    {
+        m_FrustumChunks = m_ChunkCuller.GetChunks();
+    }
+
+    // Without a loaded camera chunk there is nowhere to start, everything in the frustum is drawn then
+    bool occlusion = occlusionCulling && m_SectionOcclusion.Run(m_ChunkGrid, camera);
+    if (occlusion)
+        m_CullStats.visitedSections = m_SectionOcclusion.GetStats().visitedSections;
+
+    if (depthOcclusionCulling)
+    {
+        m_OcclusionBuffer.Finish();
+
+        OcclusionBuffer::Stats stats = m_OcclusionBuffer.GetStats();
+        m_CullStats.occluderBoxes = stats.occluders;
+        m_CullStats.occluderTriangles = stats.triangles;
+        m_CullStats.workerBands = stats.workerBands;
+    }
+
+    for (Chunk* chunk : m_FrustumChunks)
+    {
+        uint32_t sections = chunk->GetMeshSections();
+        m_CullStats.sectionsInFrustum += std::popcount(sections);
+
+        if (occlusion)
+            sections &= m_SectionOcclusion.GetReachedSections(*chunk);
+
+        if (sections == 0)
+        {
+            m_CullStats.occluded++;
+            continue;
+        }
+
+        // Only around the sections that are left, they are often much lower than the whole mesh
+        glm::vec3 boxMin, boxMax;
+        if (!chunk->GetMeshBounds(boxMin, boxMax, sections))
+            continue;
+
+        if (depthOcclusionCulling)
+        {
+            m_CullStats.depthTested++;
+            if (!m_OcclusionBuffer.IsVisible(boxMin, boxMax))
+            {
+                m_CullStats.depthOccluded++;
                 continue;
             }
         }
 
-        chunk->Render(renderer, shader, layer);
+        float distance = glm::length((boxMin + boxMax) * 0.5f - camera.GetPosition());
+        uint16_t key = (uint16_t)std::min(distance / DISTANCE_STEP, 65535.0f);
+
+        m_CullStats.sectionsDrawn += std::popcount(sections);
+        m_VisibleChunks.push_back({ chunk, sections, key });
+    }
+
+    m_CullStats.visible = (int)m_VisibleChunks.size();
+    SortVisibleChunks();
+
+    // One range per layer, so each pass is a single contiguous multi draw
+    for (int layer = 0; layer < LAYER_COUNT; layer++)
+    {
+        DrawRange& range = m_LayerRanges[layer];
+        range.first = m_DrawCommands.size();
+
+        // A multi draw keeps the order of its commands. Opaque layers near to far so early depth testing skips what is hidden,
+        // water far to near so it blends over the water behind it.
+        if (layer == 2)
+        {
+            for (auto it = m_VisibleChunks.rbegin(); it != m_VisibleChunks.rend(); ++it)
+                it->chunk->AppendDrawCommand(layer, m_DrawCommands, it->sections);
+        }
+        else
+        {
+            for (const VisibleChunk& visible : m_VisibleChunks)
+                visible.chunk->AppendDrawCommand(layer, m_DrawCommands, visible.sections);
+        }
+
+        range.count = m_DrawCommands.size() - range.first;
+        m_CullStats.drawn[layer] = (int)range.count;
+    }
+}
+
+void World::SortVisibleChunks()
+{
+    // Radix sort on the 16 bit distance, a byte per pass. Stable, so chunks at the same distance keep their grid order.
+    m_SortScratch.resize(m_VisibleChunks.size());
+
+    for (int shift = 0; shift < 16; shift += 8)
+    {
+        size_t offsets[256] = {};
+        for (const VisibleChunk& visible : m_VisibleChunks)
+            offsets[(visible.distance >> shift) & 0xFF]++;
+
+        size_t total = 0;
+        for (size_t& offset : offsets)
+        {
+            size_t count = offset;
+            offset = total;
+            total += count;
+        }
+
+        for (const VisibleChunk& visible : m_VisibleChunks)
+            m_SortScratch[offsets[(visible.distance >> shift) & 0xFF]++] = visible;
+
+        m_VisibleChunks.swap(m_SortScratch);
     }
 }
 
+void World::Render(Renderer& renderer, int layer)
+{
+    const DrawRange& range = m_LayerRanges[layer];
+    m_MeshArena.Draw(renderer, std::span(m_DrawCommands).subspan(range.first, range.count));
+}
+
 bool World::Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, glm::ivec3& hitBlock, glm::ivec3& placeBlock)
 {
     // The DDA algorithm works on a grid where boundaries are at integers (0, 1, 2).
@@ -425,7 +991,8 @@ bool World::Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, gl
 			lastcz = cz;
         }
 
-        if (raycastChunk)
+        // Chunks still generating are skipped like missing ones, their sections are being written on a worker
+        if (raycastChunk && raycastChunk->IsTerrainGenerated())
         {
             BlockType type = raycastChunk->GetBlockType(WorldToLocal(x), y, WorldToLocal(z));
 
@@ -575,55 +1142,7 @@ int World::WorldToLocal(int x)
     return r < 0 ? r + 16 : r;
 }
 
-void World::InitThreadPool(int numThreads)
-{
-	for (int i = 0; i < numThreads; i++)
-    {
-        m_WorkerThreads.emplace_back(&World::WorkerThreadLoop, this);
-    }
-}
-
-void World::WorkerThreadLoop()
+void World::EnqueueJob(Job job)
 {
-    while (true)
-    {
-        std::function<void()> job;
-        {
-			std::unique_lock<std::mutex> lock(m_QueueMutex);
-			m_Condition.wait(lock, [this]
-            {
-                    return m_ShutDownThreadPool || !m_JobQueue.empty();
-            });
-
-            if (m_ShutDownThreadPool && m_JobQueue.empty())
-				return;
-
-			job = std::move(m_JobQueue.front());
-			m_JobQueue.pop();
-        }
-        job();
-	}
-}
-
-void World::ShutdownThreadPool() {
-    {
-        std::unique_lock<std::mutex> lock(m_QueueMutex);
-        m_ShutDownThreadPool = true;
-    }
-    m_Condition.notify_all();
-
-    for (auto& thread : m_WorkerThreads) {
-        if (thread.joinable()) {
-            thread.join();
-        }
-    }
-}
-
-void World::EnqueueJob(std::function<void()> job)
-{
-    {
-        std::unique_lock<std::mutex> lock(m_QueueMutex);
-        m_JobQueue.push(std::move(job));
-    }
-    m_Condition.notify_one();
+    m_JobSystem.Submit(std::move(job));
 }
\ No newline at end of file
@@ -11,14 +11,22 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
-#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 
 #include "../VertexBufferLayout.h"
 #include "Block.h"
+#include "MeshBufferPool.h"
+#include "ChunkGrid.h"
+#include "ChunkMeshArena.h"
+#include "ChunkCuller.h"
+#include "SectionOcclusion.h"
+#include "OcclusionBuffer.h"
+#include "../JobSystem.h"
 
 class Chunk;
 
-// ivec2 hash function for unordered_map, i cant get glms hash to work for some reason
+// ivec2 hash function for unordered_set, i cant get glms hash to work for some reason
 namespace std {
 	template<>
 	struct hash<glm::ivec2> {
@@ -38,17 +46,56 @@ public:
 	~World();
 
 	Chunk* GetChunk(int cx, int cz);
-	Chunk& CreateChunk(int cx, int cz);
 
-	void UpdateChunksInRadius(int cx, int cz, int renderDistance);
+	void UpdateChunksInRadius(const Camera& camera, int renderDistance);
 	void GenerateChunk(int cx, int cz);
 
 	void DropChunk(int cx, int cz);
 
+	// Chunks further than the render distance + unloadMargin are unloaded.
+	// Beyond the render distance the least recently seen chunks are also unloaded while all chunks together use more than memoryBudget bytes (0 = no budget).
+	int unloadMargin = 4;
+	size_t memoryBudget = 512ull * 1024 * 1024;
+
+	struct ResidencyStats {
+		size_t loadedChunks = 0;
+		size_t bytes = 0;
+		size_t unloadedChunks = 0; // Since start
+	};
+	ResidencyStats GetResidencyStats() const { return m_ResidencyStats; }
+
 	BlockType GetBlock(int wx, int wy, int wz);
 	void SetBlock(int wx, int wy, int wz, BlockType type);
 
-	void Render(Renderer& renderer, Shader& shader, Camera& camera, int layer);
+	// Frustum culls the loaded chunks once per frame and builds the draw commands of every layer.
+	// Call after UpdateChunksInRadius, the render passes of the frame then only draw what was collected here.
+	// projection is the one the frame is rendered with, for the occlusion buffer.
+	void CullChunks(const Camera& camera, const glm::mat4& projection);
+	// Draws the chunks CullChunks collected for the layer, with the shader the caller bound
+	void Render(Renderer& renderer, int layer);
+
+	// Solid, cutout, translucent
+	static constexpr int LAYER_COUNT = 3;
+
+	struct CullStats {
+		int candidates = 0;	// Chunks that could be drawn
+		int regionTests = 0;	// Frustum tests of chunk regions, see ChunkCuller
+		int chunkTests = 0;		// Frustum tests of single chunks
+		int visible = 0;
+		int inside = 0;		// Visible chunks completely inside the frustum
+		int empty = 0;		// Skipped without a test, the mesh has no vertices (only with tightChunkBounds)
+		int drawn[LAYER_COUNT] = {}; // Draw commands per layer, chunks without vertices in a layer are skipped
+		int occluded = 0;			// Visible chunks whose sections were all hidden
+		int visitedSections = 0;	// By the occlusion walk
+		int sectionsInFrustum = 0;	// Sections with geometry in the visible chunks
+		int sectionsDrawn = 0;		// Of those, the ones not occluded
+		int occluderBoxes = 0;		// Drawn into the occlusion buffer
+		int occluderTriangles = 0;
+		int workerBands = 0;		// Occlusion buffer bands rasterized by workers, the main thread did the rest
+		int depthTested = 0;		// Chunks tested against the occlusion buffer
+		int depthOccluded = 0;		// Of those, the ones behind the occluders
+	};
+	CullStats GetCullStats() const { return m_CullStats; }
 
 	bool Raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, glm::ivec3& hitBlock, glm::ivec3& placeBlock);
 
@@ -75,16 +122,73 @@ public:
 		return cosAngle >= cosHalfFov;
 	}
 
-	void NotifyNeighborsOfNewChunk(int cx, int cz);
-	void MarkChunkDirty(int cx, int cz);
+	// Queues an Update call for the chunk on the main thread, can be called from any thread.
+	// Only chunks that asked for it get updated each frame, not the whole render distance.
+	void RequestChunkUpdate(glm::ivec2 coord);
+	size_t GetPendingChunkUpdates() const { return m_PendingUpdates.size(); }
+
+	// Mesh uploads per frame stop once either budget is used up, the rest waits for the next frame.
+	// At least one upload happens every frame so streaming never stalls.
+	float uploadBudgetMs = 2.0f;
+	size_t uploadBudgetBytes = 4 * 1024 * 1024;
+
+	struct UploadStats {
+		int uploads = 0;	// Last frame
+		size_t bytes = 0;
+		float milliseconds = 0.0f;
+		int deferred = 0;	// Meshes that didnt fit the budget
+	};
+	UploadStats GetUploadStats() const { return m_UploadStats; }
+
+	// Jobs that were dropped because their chunk left the window or got unloaded
+	struct CancelStats {
+		uint64_t terrainJobs = 0;
+		uint64_t meshJobs = 0;
+	};
+	CancelStats GetCancelStats() const { return { m_CancelledTerrainJobs, m_CancelledMeshJobs }; }
+	void CountCancelledJob(bool terrain) { (terrain ? m_CancelledTerrainJobs : m_CancelledMeshJobs)++; }
 
 	bool frustumCulling = true;
-	void EnqueueJob(std::function<void()> job);
+
+	// Cull chunks by the height range of their mesh instead of the full chunk height
+	bool tightChunkBounds = true;
+
+	// Test regions of chunks first, only chunks in regions crossing the frustum are tested one by one
+	bool hierarchicalCulling = true;
+
+	// Only draw sections the camera can see through the sections in between, see SectionOcclusion
+	bool occlusionCulling = true;
+
+	// Test the chunks against a small depth buffer of the ground around the camera, see OcclusionBuffer.
+	// Every chunk up to occluderDistance chunks away is drawn into it.
+	bool depthOcclusionCulling = true;
+	int occluderDistance = 4;
+	const OcclusionBuffer& GetOcclusionBuffer() const { return m_OcclusionBuffer; }
+	bool greedyMeshing = true;
+
+	// Marks every loaded chunk dirty, used when switching meshing modes
+	void RemeshAllChunks();
+
+	struct MeshStats {
+		size_t solidVertices = 0;
+		size_t waterVertices = 0;
+		size_t meshJobs = 0;		// Full mesh jobs of the loaded chunks
+		size_t meshedChunks = 0;
+	};
+	MeshStats GetMeshStats();
+
+	MeshBufferPool& GetMeshBufferPool() { return m_MeshBufferPool; }
+	ChunkMeshArena& GetMeshArena() { return m_MeshArena; }
+
+	void EnqueueJob(Job job);
+	int GetWorkerCount() const { return m_JobSystem.GetThreadCount(); }
+	int GetPendingJobs() const { return m_JobSystem.GetPendingJobs(); }
 
 private:	
 	int m_Seed;
 	FastNoiseLite m_Noise { m_Seed };
-	std::unordered_map<glm::ivec2, std::shared_ptr<Chunk>> m_Chunks;
+	// Loaded chunks. Sized for the render distance + unload margin in UpdateChunksInRadius
+	ChunkGrid m_ChunkGrid{ 32 };
 
 	FastNoiseLite m_BaseNoise;
 	FastNoiseLite m_MountainNoise;
@@ -92,25 +196,99 @@ private:
 	FastNoiseLite m_TreeDensityNoise;
 
 	std::atomic<int> m_ActiveChunkGenerations{ 0 };
-	static constexpr int MAX_CONCURRENT_GENERATIONS = 4;
+
+	std::atomic<uint64_t> m_CancelledTerrainJobs{ 0 };
+	std::atomic<uint64_t> m_CancelledMeshJobs{ 0 };
+	int m_MaxConcurrentGenerations = 4; // One per worker, see World()
 
 	// Raycasting cache
 	int lastcx = INT_MIN;
 	int lastcz = INT_MIN;
 	Chunk* raycastChunk = nullptr;
 
-	std::queue<glm::ivec2> m_ChunkGenQueue;
+	// Chunks waiting for terrain generation, lowest priority value first
+	struct ChunkLoadRequest {
+		float priority;
+		glm::ivec2 coord;
+
+		bool operator>(const ChunkLoadRequest& other) const { return priority > other.priority; }
+	};
+	std::priority_queue<ChunkLoadRequest, std::vector<ChunkLoadRequest>, std::greater<ChunkLoadRequest>> m_ChunkGenQueue;
+
+	// Camera state the queue was last built for
+	glm::ivec2 m_GenQueueCenter{ INT_MIN, INT_MIN };
+	glm::vec2 m_GenQueueForward{ 0.0f };
+	int m_GenQueueRadius = 0;
+
+	void RebuildChunkGenQueue(const Camera& camera, int cx, int cz, int renderDistance);
+
+	uint64_t m_FrameIndex = 0;
+	ResidencyStats m_ResidencyStats;
+	bool m_ResidencyChanged = true;
+
+	// Streaming window, every chunk within m_WindowRadius of m_WindowCenter. Only changes when the camera enters another chunk.
+	glm::ivec2 m_WindowCenter{ INT_MIN, INT_MIN };
+	int m_WindowRadius = -1;
+
+	bool InWindow(glm::ivec2 coord) const { return std::max(std::abs(coord.x - m_WindowCenter.x), std::abs(coord.y - m_WindowCenter.y)) <= m_WindowRadius; }
+	void MoveWindow(int cx, int cz, int renderDistance);
+
+	// Chunks in the window that still need Update calls, main thread only
+	std::unordered_set<glm::ivec2> m_PendingUpdates;
+
+	// Requests from RequestChunkUpdate, moved into m_PendingUpdates once per frame
+	std::vector<glm::ivec2> m_UpdateRequests;
+	std::mutex m_UpdateRequestsMutex;
+
+	void UpdatePendingChunks();
+	UploadStats m_UploadStats;
+
+	// Moves the chunk and its neighbors from DECORATED to READY if all their neighbors are decorated, main thread only
+	void PromoteNeighborhood(glm::ivec2 coord);
+	void TryPromote(glm::ivec2 coord);
+
+	void UnloadChunks(int cx, int cz, int renderDistance);
+
+	void InsertChunk(glm::ivec2 coord, std::shared_ptr<Chunk> chunk);
+
+	// Releases the GPU side of chunks that were taken out of the grid, main thread only
+	void ReleaseChunks(const std::vector<std::shared_ptr<Chunk>>& chunks);
+
+	MeshBufferPool m_MeshBufferPool;
+
+	// GPU memory of every chunk mesh, drawn with one multi draw per layer
+	ChunkMeshArena m_MeshArena;
+
+	// Built by CullChunks. The commands of all layers are stored back to back, m_LayerRanges says where each layer is.
+	struct DrawRange {
+		size_t first = 0;
+		size_t count = 0;
+	};
+	struct VisibleChunk {
+		Chunk* chunk;
+		uint32_t sections; // Sections to draw
+		uint16_t distance; // From the camera to the center of the sections, in DISTANCE_STEP units
+	};
+	std::vector<VisibleChunk> m_VisibleChunks;
+
+	// Sorted near to far by SortVisibleChunks, opaque layers are drawn in that order and water the other way around
+	static constexpr float DISTANCE_STEP = 0.25f;
+	std::vector<VisibleChunk> m_SortScratch;
+	void SortVisibleChunks();
+	std::vector<Chunk*> m_FrustumChunks;
+
+	ChunkCuller m_ChunkCuller;
+	SectionOcclusion m_SectionOcclusion;
+	OcclusionBuffer m_OcclusionBuffer;
+	std::vector<uint8_t> m_OccluderHeights; // Chunk quadrants around the camera, see BeginOcclusionBuffer
 
-	// Thread Pool
-	std::vector<std::thread> m_WorkerThreads;
-	std::queue<std::function<void()>> m_JobQueue;
-	std::mutex m_QueueMutex;
-	std::condition_variable m_Condition;
-	std::atomic<bool> m_ShutDownThreadPool{ false };
+	// Adds the occluders around the camera and starts the band jobs, CullChunks waits for them in OcclusionBuffer::Finish
+	void BeginOcclusionBuffer(const Camera& camera, const glm::mat4& projection);
 
-	std::mutex m_ChunksMutex;
+	std::vector<ChunkMeshArena::DrawCommand> m_DrawCommands;
+	DrawRange m_LayerRanges[LAYER_COUNT];
+	CullStats m_CullStats;
 
-	void InitThreadPool(int numThreads = 4);
-	void ShutdownThreadPool();
-	void WorkerThreadLoop();
+	// Terrain and mesh jobs. Declared last so the workers are stopped before anything they use is destroyed
+	JobSystem m_JobSystem;
 };
\ No newline at end of file
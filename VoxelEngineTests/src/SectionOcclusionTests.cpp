@@ -0,0 +1,168 @@
+#include "world/SectionVisibility.h"
+#include "world/SectionOcclusion.h"
+#include "world/Chunk.h"
+#include "world/ChunkGrid.h"
+#include "Camera.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+/*
+* Headless tests for the section visibility graph and the walk over it, nothing here needs a window or a GL context.
+* Exits with the number of failed checks.
+*/
+
+static int s_Failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); s_Failures++; } } while (0)
+
+static constexpr int SIZE = SectionVisibility::SIZE;
+
+static int Index(int x, int y, int z) { return (y * SIZE + z) * SIZE + x; }
+
+static uint16_t Bit(int a, int b) { return (uint16_t)(1 << SectionVisibility::PairBit(a, b)); }
+
+static void TestCompute()
+{
+    static uint8_t opaque[SIZE * SIZE * SIZE];
+
+    // Solid connects nothing
+    std::memset(opaque, 1, sizeof(opaque));
+    CHECK(SectionVisibility::Compute(opaque).bits == SectionVisibility::Closed().bits);
+
+    // Air connects everything
+    std::memset(opaque, 0, sizeof(opaque));
+    CHECK(SectionVisibility::Compute(opaque).bits == SectionVisibility::ALL);
+
+    // Solid with a one block tunnel along z only connects front and back
+    std::memset(opaque, 1, sizeof(opaque));
+    for (int z = 0; z < SIZE; z++)
+        opaque[Index(5, 7, z)] = 0;
+    CHECK(SectionVisibility::Compute(opaque).bits == Bit(Chunk::FACE_FRONT, Chunk::FACE_BACK));
+
+    // A cave that doesnt touch the border doesnt connect anything either
+    std::memset(opaque, 1, sizeof(opaque));
+    for (int y = 4; y < 12; y++)
+        for (int z = 4; z < 12; z++)
+            for (int x = 4; x < 12; x++)
+                opaque[Index(x, y, z)] = 0;
+    CHECK(SectionVisibility::Compute(opaque).bits == 0);
+
+    // A wall across x splits the section, both halves still reach the other four faces but not each other
+    std::memset(opaque, 0, sizeof(opaque));
+    for (int y = 0; y < SIZE; y++)
+        for (int z = 0; z < SIZE; z++)
+            opaque[Index(8, y, z)] = 1;
+    SectionVisibility wall = SectionVisibility::Compute(opaque);
+    CHECK(!wall.Connected(Chunk::FACE_LEFT, Chunk::FACE_RIGHT));
+    CHECK(wall.Connected(Chunk::FACE_LEFT, Chunk::FACE_FRONT));
+    CHECK(wall.Connected(Chunk::FACE_RIGHT, Chunk::FACE_TOP));
+    CHECK(wall.Connected(Chunk::FACE_FRONT, Chunk::FACE_BACK));
+}
+
+// Chunks (0, 0), (0, -1) and (0, -2) with the camera in section 4 of the first one, looking down -z at the others
+struct WalkFixture
+{
+    static constexpr int SECTION = 4;
+
+    ChunkGrid grid{ 4 };
+    std::shared_ptr<Chunk> chunks[3];
+    Camera camera{ glm::vec3(8.0f, SECTION * Chunk::SECTION_SIZE + 8.0f, 8.0f), glm::vec3(0, 1, 0), -90.0f, 0.0f, 16.0f / 9.0f };
+    SectionOcclusion occlusion;
+
+    WalkFixture()
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            chunks[i] = std::make_shared<Chunk>(glm::ivec2(0, -i));
+            grid.Insert({ 0, -i }, chunks[i]);
+        }
+    }
+
+    void SetAll(Chunk& chunk, SectionVisibility visibility)
+    {
+        for (int i = 0; i < Chunk::SECTION_COUNT; i++)
+            chunk.SetSectionVisibility(i, visibility);
+    }
+
+    uint8_t Reached(int i) { return occlusion.GetReachedSections(*chunks[i]); }
+};
+
+static void TestWalk()
+{
+    const uint8_t section = 1 << WalkFixture::SECTION;
+
+    // Nothing to start from if the camera chunk isnt loaded
+    {
+        WalkFixture fixture;
+        Camera outside(glm::vec3(8.0f, 72.0f, 100.0f), glm::vec3(0, 1, 0), -90.0f, 0.0f, 16.0f / 9.0f);
+        CHECK(!fixture.occlusion.Run(fixture.grid, outside));
+        CHECK(fixture.Reached(0) == 0);
+    }
+
+    // Open sections let the walk through to the far chunk
+    {
+        WalkFixture fixture;
+        CHECK(fixture.occlusion.Run(fixture.grid, fixture.camera));
+        CHECK(fixture.Reached(0) & section);
+        CHECK(fixture.Reached(1) & section);
+        CHECK(fixture.Reached(2) & section);
+    }
+
+    // A closed chunk is seen itself but hides the one behind it, even though every other section is open
+    {
+        WalkFixture fixture;
+        fixture.SetAll(*fixture.chunks[1], SectionVisibility::Closed());
+        CHECK(fixture.occlusion.Run(fixture.grid, fixture.camera));
+        CHECK(fixture.Reached(1) & section);
+        CHECK(fixture.Reached(2) == 0);
+    }
+
+    // A tunnel from front to back through the closed chunk opens the far chunk again, but only along the tunnel
+    {
+        WalkFixture fixture;
+        fixture.SetAll(*fixture.chunks[1], SectionVisibility::Closed());
+
+        SectionVisibility tunnel = SectionVisibility::Closed();
+        tunnel.ConnectFaces((1 << Chunk::FACE_FRONT) | (1 << Chunk::FACE_BACK));
+        fixture.chunks[1]->SetSectionVisibility(WalkFixture::SECTION, tunnel);
+
+        CHECK(fixture.occlusion.Run(fixture.grid, fixture.camera));
+        CHECK(fixture.Reached(2) & section);
+    }
+
+    // A sideways tunnel connects the wrong faces, the far chunk stays hidden
+    {
+        WalkFixture fixture;
+        fixture.SetAll(*fixture.chunks[1], SectionVisibility::Closed());
+
+        SectionVisibility tunnel = SectionVisibility::Closed();
+        tunnel.ConnectFaces((1 << Chunk::FACE_LEFT) | (1 << Chunk::FACE_RIGHT));
+        fixture.chunks[1]->SetSectionVisibility(WalkFixture::SECTION, tunnel);
+
+        CHECK(fixture.occlusion.Run(fixture.grid, fixture.camera));
+        CHECK(fixture.Reached(2) == 0);
+    }
+
+    // A chunk behind the camera is outside the frustum and never reached
+    {
+        WalkFixture fixture;
+        auto behind = std::make_shared<Chunk>(glm::ivec2(0, 1));
+        fixture.grid.Insert({ 0, 1 }, behind);
+        CHECK(fixture.occlusion.Run(fixture.grid, fixture.camera));
+        CHECK(fixture.occlusion.GetReachedSections(*behind) == 0);
+    }
+}
+
+int main()
+{
+    TestCompute();
+    TestWalk();
+
+    if (s_Failures == 0)
+        std::printf("All section occlusion tests passed\n");
+
+    return s_Failures;
+}